@@ -0,0 +1,347 @@
+use std::io::{Read, Write};
+use std::time::{Duration, Instant};
+
+use serde::Serialize;
+use speedwagon::{Packet, PacketType};
+
+use crate::diag::{self, CanStats};
+
+/// Request types the benchmark knows how to send
+#[derive(Clone, Copy, Debug, PartialEq, Eq, Serialize)]
+#[serde(rename_all = "lowercase")]
+pub enum Request {
+    Identify,
+    Status,
+    Ping,
+}
+
+impl Request {
+    fn parse(s: &str) -> Option<Self> {
+        match s.to_lowercase().as_str() {
+            "identify" => Some(Request::Identify),
+            "status" => Some(Request::Status),
+            "ping" => Some(Request::Ping),
+            _ => None,
+        }
+    }
+
+    fn packet(self, id: u8) -> Packet {
+        let typ = match self {
+            Request::Identify => PacketType::Identify,
+            Request::Status => PacketType::Status,
+            Request::Ping => PacketType::Ping,
+        };
+
+        Packet::new(id.into(), typ)
+    }
+
+    /// Error responses count as failed requests, whatever their code
+    fn is_response(self, typ: &PacketType) -> bool {
+        match (self, typ) {
+            (_, PacketType::Error { .. }) => false,
+            (Request::Identify, PacketType::OnIdentify(_)) => true,
+            (Request::Status, PacketType::OnStatus(_)) => true,
+            // NOTE(patrik): Ping has no answer of its own, anything but an
+            // error with the right id counts
+            (Request::Ping, _) => true,
+            _ => false,
+        }
+    }
+}
+
+/// Parses a mix like "ping=1,status=4" into a weighted round robin
+/// sequence, "status" alone is the same as "status=1"
+pub fn parse_mix(mix: &str) -> Option<Vec<Request>> {
+    let mut sequence = Vec::new();
+
+    for entry in mix.split(',') {
+        let mut split = entry.split('=');
+        let request = Request::parse(split.next()?.trim())?;
+        let weight = match split.next() {
+            Some(weight) => weight.trim().parse::<usize>().ok()?,
+            None => 1,
+        };
+
+        sequence.extend(std::iter::repeat(request).take(weight));
+    }
+
+    if sequence.is_empty() {
+        None
+    } else {
+        Some(sequence)
+    }
+}
+
+pub struct Config {
+    pub mix: Vec<Request>,
+    /// Requests per second, 0 runs closed loop (next request as soon as
+    /// the last response arrived)
+    pub rate: u32,
+    pub duration: Duration,
+    /// Also collect the firmware's CAN latency stats for the run, to see
+    /// how CAN holds up while the COM channel is loaded
+    pub can_stats: bool,
+}
+
+#[derive(Serialize, Default)]
+pub struct Latency {
+    pub min_us: u64,
+    pub mean_us: u64,
+    pub p50_us: u64,
+    pub p99_us: u64,
+    pub p999_us: u64,
+    pub max_us: u64,
+}
+
+impl Latency {
+    fn from_samples(samples: &mut [u64]) -> Self {
+        if samples.is_empty() {
+            return Self::default();
+        }
+
+        samples.sort_unstable();
+
+        let percentile = |p: f64| {
+            let index = ((samples.len() as f64 * p).ceil() as usize)
+                .saturating_sub(1)
+                .min(samples.len() - 1);
+            samples[index]
+        };
+
+        let sum: u64 = samples.iter().sum();
+
+        Self {
+            min_us: samples[0],
+            mean_us: sum / samples.len() as u64,
+            p50_us: percentile(0.50),
+            p99_us: percentile(0.99),
+            p999_us: percentile(0.999),
+            max_us: samples[samples.len() - 1],
+        }
+    }
+}
+
+#[derive(Serialize)]
+pub struct RequestReport {
+    pub request: Request,
+    pub sent: u64,
+    pub errors: u64,
+    pub latency: Latency,
+}
+
+#[derive(Serialize)]
+pub struct Report {
+    pub device: String,
+    pub version: String,
+    pub rate: u32,
+    pub duration_s: f64,
+    pub sent: u64,
+    pub errors: u64,
+    pub throughput: f64,
+    pub latency: Latency,
+    pub requests: Vec<RequestReport>,
+    pub can: Option<CanStats>,
+}
+
+impl Report {
+    pub fn print(&self) {
+        println!("Device: {} ({})", self.device, self.version);
+        println!(
+            "Sent: {}  Errors: {}  Throughput: {:.1} req/s",
+            self.sent, self.errors, self.throughput
+        );
+
+        let print_latency = |name: &str, latency: &Latency| {
+            println!(
+                "{:>10}: p50 {:>6} us  p99 {:>6} us  p999 {:>6} us  max \
+                 {:>6} us",
+                name,
+                latency.p50_us,
+                latency.p99_us,
+                latency.p999_us,
+                latency.max_us
+            );
+        };
+
+        print_latency("all", &self.latency);
+        for request in &self.requests {
+            print_latency(&format!("{:?}", request.request), &request.latency);
+        }
+
+        if let Some(can) = &self.can {
+            println!(
+                "{:>10}: {} frames  mean {:>6} us  max {:>6} us",
+                "CAN", can.frames, can.mean_us, can.max_us
+            );
+        }
+    }
+}
+
+/// Reads packets until the response to the request with id shows up,
+/// answers to earlier requests (late, after a timeout) are dropped
+fn read_response<P>(port: &mut P, id: u8) -> Option<Packet>
+where
+    P: Read + Write,
+{
+    loop {
+        let packet = Packet::deserialize(port).ok()?;
+        if packet.id() as u32 == id as u32 {
+            return Some(packet);
+        }
+    }
+}
+
+fn round_trip<P>(port: &mut P, request: Request, id: u8) -> bool
+where
+    P: Read + Write,
+{
+    if request.packet(id).serialize(port).is_err() {
+        return false;
+    }
+
+    match read_response(port, id) {
+        Some(packet) => request.is_response(packet.typ()),
+        None => false,
+    }
+}
+
+struct Device {
+    name: String,
+    version: String,
+}
+
+fn identify<P>(port: &mut P) -> Device
+where
+    P: Read + Write,
+{
+    let unknown = Device {
+        name: String::from("unknown"),
+        version: String::from("unknown"),
+    };
+
+    if Request::Identify.packet(0).serialize(port).is_err() {
+        return unknown;
+    }
+
+    let Some(packet) = read_response(port, 0) else {
+        return unknown;
+    };
+
+    match packet.typ() {
+        PacketType::OnIdentify(identity) => Device {
+            name: identity.name.clone(),
+            version: format!("{:?}", identity.version),
+        },
+        _ => unknown,
+    }
+}
+
+struct Samples {
+    request: Request,
+    latencies: Vec<u64>,
+    errors: u64,
+}
+
+pub fn run<P>(port: &mut P, config: &Config) -> Report
+where
+    P: Read + Write,
+{
+    let device = identify(port);
+
+    if config.can_stats {
+        diag::can_stats(port, true).expect("Failed to reset CAN stats");
+    }
+
+    let interval = if config.rate > 0 {
+        Some(Duration::from_secs(1) / config.rate)
+    } else {
+        None
+    };
+
+    let mut samples: Vec<Samples> = Vec::new();
+    for request in &config.mix {
+        if !samples.iter().any(|s| s.request == *request) {
+            samples.push(Samples {
+                request: *request,
+                latencies: Vec::new(),
+                errors: 0,
+            });
+        }
+    }
+
+    let start = Instant::now();
+    let mut index = 0u32;
+    // NOTE(patrik): Packet ids are a byte on the wire, 0 is left for the
+    // identify above
+    let mut id = 0u8;
+
+    loop {
+        let scheduled = match interval {
+            Some(interval) => start + interval * index,
+            None => Instant::now(),
+        };
+
+        if scheduled.duration_since(start) >= config.duration {
+            break;
+        }
+
+        let now = Instant::now();
+        if scheduled > now {
+            std::thread::sleep(scheduled - now);
+        }
+
+        let request = config.mix[index as usize % config.mix.len()];
+        let entry = samples
+            .iter_mut()
+            .find(|s| s.request == request)
+            .expect("Request missing from the mix");
+
+        // NOTE(patrik): Latency is measured from when the request was
+        // scheduled, not when it went out, so a slow response also
+        // counts against the requests queued up behind it
+        id = id.wrapping_add(1).max(1);
+        if round_trip(port, request, id) {
+            entry.latencies.push(scheduled.elapsed().as_micros() as u64);
+        } else {
+            entry.errors += 1;
+        }
+
+        index += 1;
+    }
+
+    let elapsed = start.elapsed().as_secs_f64();
+
+    let can = if config.can_stats {
+        Some(diag::can_stats(port, false).expect("Failed to read CAN stats"))
+    } else {
+        None
+    };
+
+    let mut all = Vec::new();
+    let mut errors = 0;
+    let mut requests = Vec::new();
+    for mut entry in samples {
+        all.extend_from_slice(&entry.latencies);
+        errors += entry.errors;
+
+        requests.push(RequestReport {
+            request: entry.request,
+            sent: entry.latencies.len() as u64 + entry.errors,
+            errors: entry.errors,
+            latency: Latency::from_samples(&mut entry.latencies),
+        });
+    }
+
+    Report {
+        device: device.name,
+        version: device.version,
+        rate: config.rate,
+        duration_s: elapsed,
+        sent: all.len() as u64 + errors,
+        errors,
+        throughput: all.len() as f64 / elapsed,
+        latency: Latency::from_samples(&mut all),
+        requests,
+        can,
+    }
+}
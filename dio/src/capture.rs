@@ -0,0 +1,213 @@
+use std::io::{BufWriter, ErrorKind, Read, Write};
+use std::time::{Duration, Instant};
+
+use byteorder::{LittleEndian, ReadBytesExt};
+
+use crate::frame;
+
+// NOTE(patrik): Must match CaptureCommand in the_world/src/com.cpp
+const CAPTURE_START: u8 = 0;
+const CAPTURE_STATUS: u8 = 1;
+const CAPTURE_STOP: u8 = 2;
+const CAPTURE_READ: u8 = 3;
+
+// NOTE(patrik): Must match CaptureState in the_world/src/capture.h
+const STATE_IDLE: u8 = 0;
+const STATE_ARMED: u8 = 1;
+const STATE_DONE: u8 = 3;
+
+/// How long an untriggered (ring) capture runs before it's stopped
+const RING_DURATION: Duration = Duration::from_secs(1);
+/// How long to wait on a trigger before giving up
+const TRIGGER_TIMEOUT: Duration = Duration::from_secs(30);
+
+/// Must match CaptureTrigger in the_world/src/capture.h
+pub fn parse_trigger(s: &str) -> Option<u8> {
+    match s.to_lowercase().as_str() {
+        "none" => Some(0),
+        "low" => Some(1),
+        "high" => Some(2),
+        "falling" => Some(3),
+        "rising" => Some(4),
+        _ => None,
+    }
+}
+
+pub struct Options {
+    /// Samples per second
+    pub rate: u32,
+    pub path: String,
+    /// 0 for none, see parse_trigger
+    pub trigger: u8,
+    /// Index into the device's lines
+    pub trigger_line: u8,
+}
+
+struct Status {
+    state: u8,
+    num_lines: u8,
+    rate: u32,
+    count: u32,
+}
+
+fn status<P>(port: &mut P) -> std::io::Result<Status>
+where
+    P: Read + Write,
+{
+    let mut data =
+        frame::request(port, frame::EXT_CAPTURE, &[CAPTURE_STATUS])?;
+
+    Ok(Status {
+        state: data.read_u8()?,
+        num_lines: data.read_u8()?,
+        rate: data.read_u32::<LittleEndian>()?,
+        count: data.read_u32::<LittleEndian>()?,
+    })
+}
+
+/// Reads the run length encoded samples, adjacent runs with the same
+/// levels (cut at packet boundaries) are joined back up
+fn read_runs<P>(port: &mut P, count: u32) -> std::io::Result<Vec<(u16, u32)>>
+where
+    P: Read + Write,
+{
+    let mut runs: Vec<(u16, u32)> = Vec::new();
+    let mut first = 0u32;
+
+    while first < count {
+        let mut request = vec![CAPTURE_READ];
+        request.extend_from_slice(&first.to_le_bytes());
+        let mut data = frame::request(port, frame::EXT_CAPTURE, &request)?;
+
+        let _first = data.read_u32::<LittleEndian>()?;
+        let num_runs = data.read_u8()?;
+        if num_runs == 0 {
+            break;
+        }
+
+        for _ in 0..num_runs {
+            let levels = data.read_u16::<LittleEndian>()?;
+            let length = data.read_u16::<LittleEndian>()? as u32;
+            first += length;
+
+            match runs.last_mut() {
+                Some(last) if last.0 == levels => last.1 += length,
+                _ => runs.push((levels, length)),
+            }
+        }
+    }
+
+    Ok(runs)
+}
+
+/// Value change dump, opens in GTKWave, PulseView (sigrok) and friends
+fn write_vcd<W>(
+    out: &mut W,
+    runs: &[(u16, u32)],
+    num_lines: u8,
+    rate: u32,
+) -> std::io::Result<()>
+where
+    W: Write,
+{
+    let id = |line: u8| (b'!' + line) as char;
+
+    writeln!(out, "$timescale 1 ns $end")?;
+    writeln!(out, "$scope module the_world $end")?;
+    for line in 0..num_lines {
+        writeln!(out, "$var wire 1 {} line{} $end", id(line), line)?;
+    }
+    writeln!(out, "$upscope $end")?;
+    writeln!(out, "$enddefinitions $end")?;
+
+    let mut sample = 0u64;
+    let mut previous: Option<u16> = None;
+    for (levels, length) in runs {
+        writeln!(out, "#{}", sample * 1_000_000_000 / rate as u64)?;
+        for line in 0..num_lines {
+            let bit = (levels >> line) & 1;
+            let changed = match previous {
+                Some(previous) => (previous >> line) & 1 != bit,
+                None => true,
+            };
+
+            if changed {
+                writeln!(out, "{}{}", bit, id(line))?;
+            }
+        }
+
+        previous = Some(*levels);
+        sample += *length as u64;
+    }
+
+    writeln!(out, "#{}", sample * 1_000_000_000 / rate as u64)?;
+
+    Ok(())
+}
+
+/// Runs a capture of the input lines on the firmware and writes it as a VCD
+/// file. Without a trigger the newest samples after RING_DURATION are kept.
+pub fn run<P>(port: &mut P, options: &Options) -> std::io::Result<()>
+where
+    P: Read + Write,
+{
+    let mut request = vec![CAPTURE_START];
+    request.extend_from_slice(&options.rate.to_le_bytes());
+    request.push(options.trigger);
+    request.push(options.trigger_line);
+    let mut data = frame::request(port, frame::EXT_CAPTURE, &request)?;
+    let actual_rate = data.read_u32::<LittleEndian>()?;
+    println!("Capturing at {} samples/s", actual_rate);
+
+    let start = Instant::now();
+    loop {
+        std::thread::sleep(Duration::from_millis(50));
+
+        let status = status(port)?;
+        if status.state == STATE_DONE {
+            break;
+        }
+
+        if status.state == STATE_IDLE {
+            return Err(std::io::Error::new(
+                ErrorKind::Other,
+                "Capture stopped without any samples",
+            ));
+        }
+
+        let timeout = if options.trigger == 0 {
+            RING_DURATION
+        } else {
+            TRIGGER_TIMEOUT
+        };
+
+        if start.elapsed() >= timeout {
+            frame::request(port, frame::EXT_CAPTURE, &[CAPTURE_STOP])?;
+
+            if status.state == STATE_ARMED {
+                return Err(std::io::Error::new(
+                    ErrorKind::TimedOut,
+                    "Trigger never fired",
+                ));
+            }
+        }
+    }
+
+    let status = status(port)?;
+    let runs = read_runs(port, status.count)?;
+    println!(
+        "Read {} samples in {} runs on {} lines",
+        status.count,
+        runs.len(),
+        status.num_lines
+    );
+
+    let file = std::fs::File::create(&options.path)?;
+    let mut out = BufWriter::new(file);
+    write_vcd(&mut out, &runs, status.num_lines, status.rate)?;
+    out.flush()?;
+
+    println!("Wrote {}", options.path);
+
+    Ok(())
+}
@@ -0,0 +1,702 @@
+use std::io::{Cursor, Read, Write};
+use std::time::Duration;
+
+use byteorder::{LittleEndian, ReadBytesExt};
+use serde::Serialize;
+
+use crate::frame;
+
+struct PowerStats {
+    uptime: u64,
+    sleep_time: u64,
+    num_wakeups: u32,
+    num_cores: u8,
+}
+
+fn power_stats<P>(port: &mut P) -> std::io::Result<PowerStats>
+where
+    P: Read + Write,
+{
+    let mut data = frame::request(port, frame::EXT_POWER, &[])?;
+
+    Ok(PowerStats {
+        uptime: data.read_u64::<LittleEndian>()?,
+        sleep_time: data.read_u64::<LittleEndian>()?,
+        num_wakeups: data.read_u32::<LittleEndian>()?,
+        // NOTE(patrik): Older firmware leaves it out, it was single core
+        num_cores: data.read_u8().unwrap_or(1),
+    })
+}
+
+/// Samples the power counters twice and prints wakeups per second and CPU
+/// utilization over the interval
+pub fn power<P>(port: &mut P, interval: Duration) -> std::io::Result<()>
+where
+    P: Read + Write,
+{
+    let first = power_stats(port)?;
+    std::thread::sleep(interval);
+    let second = power_stats(port)?;
+
+    let elapsed = (second.uptime - first.uptime) as f64;
+    let slept = (second.sleep_time - first.sleep_time) as f64;
+    let wakeups = second.num_wakeups.wrapping_sub(first.num_wakeups) as f64;
+
+    println!("Uptime: {:.1} s", second.uptime as f64 / 1_000_000.0);
+    println!("Wakeups: {:.1} /s", wakeups / (elapsed / 1_000_000.0));
+
+    // NOTE(patrik): The sleep time is summed over the cores, utilization
+    // is the average over them
+    let cores = second.num_cores.max(1) as f64;
+    println!(
+        "CPU utilization: {:.1} % ({} cores)",
+        (1.0 - slept / (elapsed * cores)) * 100.0,
+        second.num_cores
+    );
+
+    Ok(())
+}
+
+/// MCP2515 interrupt to frame dispatch latency, as measured by the firmware
+#[derive(Serialize, Default, Debug)]
+pub struct CanStats {
+    pub frames: u32,
+    pub measured: u32,
+    pub last_us: u32,
+    pub mean_us: u32,
+    pub max_us: u32,
+}
+
+pub fn can_stats<P>(port: &mut P, reset: bool) -> std::io::Result<CanStats>
+where
+    P: Read + Write,
+{
+    let mut data = frame::request(port, frame::EXT_CAN_STATS, &[reset as u8])?;
+
+    let frames = data.read_u32::<LittleEndian>()?;
+    let measured = data.read_u32::<LittleEndian>()?;
+    let last_us = data.read_u32::<LittleEndian>()?;
+    let max_us = data.read_u32::<LittleEndian>()?;
+    let total = data.read_u64::<LittleEndian>()?;
+
+    Ok(CanStats {
+        frames,
+        measured,
+        last_us,
+        mean_us: if measured > 0 {
+            (total / measured as u64) as u32
+        } else {
+            0
+        },
+        max_us,
+    })
+}
+
+/// Fixed rate update schedule of the device, lateness and skipped ticks
+#[derive(Serialize, Default, Debug)]
+pub struct ScheduleStats {
+    pub period_us: u32,
+    pub updates: u32,
+    pub overruns: u32,
+    pub last_lateness_us: u32,
+    pub max_lateness_us: u32,
+    pub dropped_edges: u32,
+}
+
+pub fn schedule<P>(port: &mut P, reset: bool) -> std::io::Result<ScheduleStats>
+where
+    P: Read + Write,
+{
+    let mut data = frame::request(port, frame::EXT_SCHEDULE, &[reset as u8])?;
+
+    Ok(ScheduleStats {
+        period_us: data.read_u32::<LittleEndian>()?,
+        updates: data.read_u32::<LittleEndian>()?,
+        overruns: data.read_u32::<LittleEndian>()?,
+        last_lateness_us: data.read_u32::<LittleEndian>()?,
+        max_lateness_us: data.read_u32::<LittleEndian>()?,
+        // NOTE(patrik): Older firmware doesn't send it
+        dropped_edges: data.read_u32::<LittleEndian>().unwrap_or(0),
+    })
+}
+
+/// Names of the boot phases in firmware order (the_world/src/boot.h)
+const BOOT_PHASES: &[&str] = &[
+    "controls ready",
+    "CAN ready",
+    "scheduler started",
+    "device ready",
+    "first CAN frame",
+    "first output",
+    "USB ready",
+    "USB mounted",
+];
+
+/// Prints when each boot phase was reached, relative to reset
+pub fn boot<P>(port: &mut P) -> std::io::Result<()>
+where
+    P: Read + Write,
+{
+    let mut data = frame::request(port, frame::EXT_BOOT, &[])?;
+
+    let num_phases = data.read_u8()? as usize;
+    for index in 0..num_phases {
+        let time = data.read_u32::<LittleEndian>()?;
+        let name = BOOT_PHASES.get(index).copied().unwrap_or("unknown");
+
+        if time == 0 {
+            println!("{:>18}: -", name);
+        } else {
+            println!("{:>18}: {:>8.3} ms", name, time as f64 / 1000.0);
+        }
+    }
+
+    Ok(())
+}
+
+/// Names of the supervised tasks in firmware order
+/// (the_world/src/supervisor.h)
+const SUPERVISED_TASKS: &[&str] = &["update", "USB", "COM"];
+
+/// Prints the watchdog state, warm restarts and how long ago each task
+/// checked in
+pub fn supervisor<P>(port: &mut P) -> std::io::Result<()>
+where
+    P: Read + Write,
+{
+    let mut data = frame::request(port, frame::EXT_SUPERVISOR, &[])?;
+
+    let warm_restart = data.read_u8()? == 1;
+    let num_warm_restarts = data.read_u16::<LittleEndian>()?;
+    let last_stalled = data.read_u8()? as usize;
+
+    println!(
+        "Boot: {}  Warm restarts: {}",
+        if warm_restart { "warm" } else { "cold" },
+        num_warm_restarts
+    );
+
+    if last_stalled != 0xff {
+        let name = SUPERVISED_TASKS
+            .get(last_stalled)
+            .copied()
+            .unwrap_or("unknown");
+        println!("Last reset: {} task stalled", name);
+    }
+
+    let num_tasks = data.read_u8()? as usize;
+    for index in 0..num_tasks {
+        let age = data.read_u32::<LittleEndian>()?;
+        let name = SUPERVISED_TASKS.get(index).copied().unwrap_or("unknown");
+
+        if age == 0 {
+            println!("{:>8}: not registered", name);
+        } else {
+            println!(
+                "{:>8}: checked in {:.1} ms ago",
+                name,
+                age as f64 / 1000.0
+            );
+        }
+    }
+
+    Ok(())
+}
+
+/// Prints the control outputs and how many GPIO writes batching saved
+pub fn controls<P>(port: &mut P) -> std::io::Result<()>
+where
+    P: Read + Write,
+{
+    let mut data = frame::request(port, frame::EXT_CONTROLS, &[])?;
+
+    let outputs = data.read_u32::<LittleEndian>()?;
+    let sets = data.read_u32::<LittleEndian>()?;
+    let commits = data.read_u32::<LittleEndian>()?;
+    let saved = data.read_u32::<LittleEndian>()?;
+
+    println!("Outputs: 0x{:08x}", outputs);
+    println!(
+        "Sets: {}  Commits: {}  Writes saved: {} ({:.1} %)",
+        sets,
+        commits,
+        saved,
+        if sets > 0 {
+            saved as f64 / sets as f64 * 100.0
+        } else {
+            0.0
+        }
+    );
+
+    Ok(())
+}
+
+/// Prints the status snapshot with its version, with watch it keeps
+/// polling and prints the status every time the version changes
+pub fn snapshot<P>(port: &mut P, watch: bool) -> std::io::Result<()>
+where
+    P: Read + Write,
+{
+    let mut known: Option<u32> = None;
+
+    loop {
+        let request = match known {
+            Some(version) => version.to_le_bytes().to_vec(),
+            None => Vec::new(),
+        };
+
+        let mut data = frame::request(port, frame::EXT_SNAPSHOT, &request)?;
+        let version = data.read_u32::<LittleEndian>()?;
+
+        // NOTE(patrik): The firmware leaves the status out when the version
+        // we sent is still the current one
+        let mut status = Vec::new();
+        data.read_to_end(&mut status)?;
+        if !status.is_empty() {
+            println!("Version {}: {:02x?}", version, status);
+        }
+
+        if !watch {
+            return Ok(());
+        }
+
+        known = Some(version);
+        std::thread::sleep(Duration::from_millis(50));
+    }
+}
+
+/// What to do with the settings stored in the device's flash
+pub enum SettingsOp {
+    List,
+    Get(u16),
+    /// No value deletes the key
+    Set(u16, Option<u32>),
+    Flush,
+    Stats,
+}
+
+// NOTE(patrik): Must match SettingsCommand in the_world/src/settings.cpp
+const SETTINGS_LIST: u8 = 0;
+const SETTINGS_GET: u8 = 1;
+const SETTINGS_SET: u8 = 2;
+const SETTINGS_FLUSH: u8 = 3;
+const SETTINGS_STATS: u8 = 4;
+
+fn print_setting(key: u16, value: &[u8]) {
+    if value.len() == 4 {
+        let number =
+            u32::from_le_bytes([value[0], value[1], value[2], value[3]]);
+        println!("0x{:04x}: {} ({:02x?})", key, number, value);
+    } else {
+        println!("0x{:04x}: {:02x?}", key, value);
+    }
+}
+
+fn print_settings_stats(data: &mut Cursor<Vec<u8>>) -> std::io::Result<()> {
+    let num_settings = data.read_u32::<LittleEndian>()?;
+    let num_dirty = data.read_u32::<LittleEndian>()?;
+    let sector_seq = data.read_u32::<LittleEndian>()?;
+    let sector_used = data.read_u32::<LittleEndian>()?;
+    let num_flushes = data.read_u32::<LittleEndian>()?;
+    let num_erases = data.read_u32::<LittleEndian>()?;
+    let num_bad_records = data.read_u32::<LittleEndian>()?;
+    let last_stall = data.read_u32::<LittleEndian>()?;
+    let max_stall = data.read_u32::<LittleEndian>()?;
+
+    println!("Settings: {}  Unsaved: {}", num_settings, num_dirty);
+    println!(
+        "Sector: #{} ({} bytes used)  Bad records at boot: {}",
+        sector_seq, sector_used, num_bad_records
+    );
+    println!(
+        "Flushes: {}  Erases: {}  Stall: {} us last, {} us max",
+        num_flushes, num_erases, last_stall, max_stall
+    );
+
+    Ok(())
+}
+
+/// Reads and changes the settings, changes are written to flash by the
+/// device on its own schedule unless flushed
+pub fn settings<P>(port: &mut P, op: SettingsOp) -> std::io::Result<()>
+where
+    P: Read + Write,
+{
+    match op {
+        SettingsOp::List => {
+            // NOTE(patrik): As many settings as fit in a packet, ask again
+            // from where the last one left off
+            let mut start = 0;
+            loop {
+                let request = [SETTINGS_LIST, start as u8];
+                let mut data =
+                    frame::request(port, frame::EXT_SETTINGS, &request)?;
+
+                let total = data.read_u8()? as usize;
+                let mut count = 0;
+                while (data.position() as usize) < data.get_ref().len() {
+                    let key = data.read_u16::<LittleEndian>()?;
+                    let len = data.read_u8()? as usize;
+                    let mut value = vec![0; len];
+                    data.read_exact(&mut value)?;
+
+                    print_setting(key, &value);
+                    count += 1;
+                }
+
+                start += count;
+                if count == 0 || start >= total {
+                    return Ok(());
+                }
+            }
+        }
+
+        SettingsOp::Get(key) => {
+            let mut request = vec![SETTINGS_GET];
+            request.extend_from_slice(&key.to_le_bytes());
+
+            let mut data =
+                frame::request(port, frame::EXT_SETTINGS, &request)?;
+            let len = data.read_u8()? as usize;
+            if len == 0 {
+                println!("0x{:04x}: not set", key);
+            } else {
+                let mut value = vec![0; len];
+                data.read_exact(&mut value)?;
+                print_setting(key, &value);
+            }
+        }
+
+        SettingsOp::Set(key, value) => {
+            let mut request = vec![SETTINGS_SET];
+            request.extend_from_slice(&key.to_le_bytes());
+            if let Some(value) = value {
+                request.extend_from_slice(&value.to_le_bytes());
+            }
+
+            frame::request(port, frame::EXT_SETTINGS, &request)?;
+        }
+
+        SettingsOp::Flush => {
+            let mut data =
+                frame::request(port, frame::EXT_SETTINGS, &[SETTINGS_FLUSH])?;
+            print_settings_stats(&mut data)?;
+        }
+
+        SettingsOp::Stats => {
+            let mut data =
+                frame::request(port, frame::EXT_SETTINGS, &[SETTINGS_STATS])?;
+            print_settings_stats(&mut data)?;
+        }
+    }
+
+    Ok(())
+}
+
+/// Prints the stack high water mark of every task and the memory left
+pub fn tasks<P>(port: &mut P) -> std::io::Result<()>
+where
+    P: Read + Write,
+{
+    let mut data = frame::request(port, frame::EXT_TASK_STATS, &[])?;
+
+    let free_heap = data.read_u32::<LittleEndian>()?;
+    let min_free_heap = data.read_u32::<LittleEndian>()?;
+    let free_ram = data.read_u32::<LittleEndian>()?;
+    let num_tasks = data.read_u8()?;
+
+    println!(
+        "Heap: {} bytes free ({} lowest)  RAM: {} bytes free",
+        free_heap, min_free_heap, free_ram
+    );
+
+    println!("{:<16} {:>12}", "Task", "Unused stack");
+    for _ in 0..num_tasks {
+        let len = data.read_u8()? as usize;
+        let mut name = vec![0; len];
+        data.read_exact(&mut name)?;
+        let high_water = data.read_u32::<LittleEndian>()?;
+
+        println!(
+            "{:<16} {:>6} words",
+            String::from_utf8_lossy(&name),
+            high_water
+        );
+    }
+
+    Ok(())
+}
+
+const PROFILE_TASKS: u8 = 0;
+const PROFILE_HANDLERS: u8 = 1;
+const PROFILE_COMMANDS: u8 = 2;
+
+// NOTE(patrik): Same order as ProfileHandler in the_world/src/profile.h
+const HANDLER_NAMES: [&str; 3] = ["update", "get_status", "on_can_message"];
+
+struct ProfileStat {
+    count: u32,
+    min: u32,
+    max: u32,
+    total: u64,
+}
+
+/// Reads every page of one profile kind, calling `entry` for each entry
+fn read_profile<P, F>(
+    port: &mut P,
+    kind: u8,
+    mut entry: F,
+) -> std::io::Result<u32>
+where
+    P: Read + Write,
+    F: FnMut(&mut Cursor<Vec<u8>>) -> std::io::Result<()>,
+{
+    let mut first = 0u8;
+
+    loop {
+        let mut data =
+            frame::request(port, frame::EXT_PROFILE, &[kind, first])?;
+
+        let total_run_time = data.read_u32::<LittleEndian>()?;
+        let num_entries = data.read_u8()?;
+        let count = data.read_u8()?;
+
+        for _ in 0..count {
+            entry(&mut data)?;
+        }
+
+        first += count;
+        if first >= num_entries || count == 0 {
+            return Ok(total_run_time);
+        }
+    }
+}
+
+fn read_task_run_times<P>(
+    port: &mut P,
+) -> std::io::Result<(u32, Vec<(String, u32)>)>
+where
+    P: Read + Write,
+{
+    let mut tasks = Vec::new();
+    let total = read_profile(port, PROFILE_TASKS, |data| {
+        let len = data.read_u8()? as usize;
+        let mut name = vec![0; len];
+        data.read_exact(&mut name)?;
+        let run_time = data.read_u32::<LittleEndian>()?;
+
+        tasks.push((String::from_utf8_lossy(&name).into_owned(), run_time));
+        Ok(())
+    })?;
+
+    Ok((total, tasks))
+}
+
+fn read_stats<P>(port: &mut P, kind: u8) -> std::io::Result<Vec<ProfileStat>>
+where
+    P: Read + Write,
+{
+    let mut stats = Vec::new();
+    read_profile(port, kind, |data| {
+        stats.push(ProfileStat {
+            count: data.read_u32::<LittleEndian>()?,
+            min: data.read_u32::<LittleEndian>()?,
+            max: data.read_u32::<LittleEndian>()?,
+            total: data.read_u64::<LittleEndian>()?,
+        });
+        Ok(())
+    })?;
+
+    Ok(stats)
+}
+
+fn print_stat(name: &str, stat: &ProfileStat) {
+    let mean = if stat.count > 0 {
+        stat.total / stat.count as u64
+    } else {
+        0
+    };
+
+    println!(
+        "{:<16} {:>10} {:>8} {:>8} {:>8}",
+        name, stat.count, stat.min, mean, stat.max
+    );
+}
+
+/// Prints CPU usage per task over `interval` and the execution time of the
+/// device handlers and commands since boot
+pub fn profile<P>(port: &mut P, interval: Duration) -> std::io::Result<()>
+where
+    P: Read + Write,
+{
+    // NOTE(patrik): The firmware counters are 32 bit us and wrap, so only
+    // the difference between two samples means anything
+    let (first_total, first) = read_task_run_times(port)?;
+    std::thread::sleep(interval);
+    let (second_total, second) = read_task_run_times(port)?;
+
+    let elapsed = second_total.wrapping_sub(first_total) as f64;
+
+    println!("{:<16} {:>8}", "Task", "CPU");
+    for (name, run_time) in &second {
+        let before = first
+            .iter()
+            .find(|(n, _)| n == name)
+            .map(|(_, t)| *t)
+            .unwrap_or(*run_time);
+        let used = run_time.wrapping_sub(before) as f64;
+
+        println!("{:<16} {:>7.2}%", name, used / elapsed * 100.0);
+    }
+
+    println!();
+    println!(
+        "{:<16} {:>10} {:>8} {:>8} {:>8}",
+        "Handler (us)", "Calls", "Min", "Mean", "Max"
+    );
+    for (index, stat) in read_stats(port, PROFILE_HANDLERS)?.iter().enumerate()
+    {
+        let name = HANDLER_NAMES.get(index).copied().unwrap_or("?");
+        print_stat(name, stat);
+    }
+
+    println!();
+    println!(
+        "{:<16} {:>10} {:>8} {:>8} {:>8}",
+        "Command (us)", "Calls", "Min", "Mean", "Max"
+    );
+    for (index, stat) in read_stats(port, PROFILE_COMMANDS)?.iter().enumerate()
+    {
+        print_stat(&format!("{}", index), stat);
+    }
+
+    Ok(())
+}
+
+// NOTE(patrik): Same order as LatencyPoint in the_world/src/latency.h
+const LATENCY_NAMES: [&str; 4] = [
+    "update_lateness",
+    "can_rx_dispatch",
+    "command_response",
+    "edge_to_output",
+];
+
+/// Bucket counts of one firmware latency histogram
+struct Histogram {
+    sub_bucket_bits: u32,
+    counts: Vec<u32>,
+}
+
+impl Histogram {
+    /// Smallest value (us) that lands in `index`, mirrors
+    /// Histogram::bucket_index in the_world/src/util/histogram.h
+    fn lower_bound(&self, index: usize) -> u64 {
+        let sub_buckets = 1usize << self.sub_bucket_bits;
+        if index < sub_buckets * 2 {
+            return index as u64;
+        }
+
+        let block = index / sub_buckets;
+        let sub = index % sub_buckets;
+        ((sub_buckets + sub) as u64) << (block - 1)
+    }
+
+    fn total(&self) -> u64 {
+        self.counts.iter().map(|c| *c as u64).sum()
+    }
+
+    /// Lower bound of the bucket holding the given percentile
+    fn percentile(&self, p: f64) -> u64 {
+        let total = self.total();
+        let target = ((total as f64 * p).ceil() as u64).max(1);
+
+        let mut seen = 0;
+        for (index, count) in self.counts.iter().enumerate() {
+            seen += *count as u64;
+            if seen >= target {
+                return self.lower_bound(index);
+            }
+        }
+
+        0
+    }
+
+    fn max(&self) -> u64 {
+        self.counts
+            .iter()
+            .rposition(|c| *c > 0)
+            .map(|index| self.lower_bound(index))
+            .unwrap_or(0)
+    }
+}
+
+fn read_histogram<P>(
+    port: &mut P,
+    point: u8,
+    reset: bool,
+) -> std::io::Result<Histogram>
+where
+    P: Read + Write,
+{
+    let mut histogram = Histogram {
+        sub_bucket_bits: 0,
+        counts: Vec::new(),
+    };
+
+    let mut first = 0u8;
+    loop {
+        let mut data = frame::request(
+            port,
+            frame::EXT_LATENCY,
+            &[point, first, reset as u8],
+        )?;
+
+        histogram.sub_bucket_bits = data.read_u8()? as u32;
+        let num_buckets = data.read_u8()?;
+        let next = data.read_u8()?;
+        let count = data.read_u8()?;
+
+        histogram.counts.resize(num_buckets as usize, 0);
+        for _ in 0..count {
+            let index = data.read_u8()? as usize;
+            let value = data.read_u32::<LittleEndian>()?;
+            if let Some(bucket) = histogram.counts.get_mut(index) {
+                *bucket = value;
+            }
+        }
+
+        if next >= num_buckets || next == first {
+            return Ok(histogram);
+        }
+        first = next;
+    }
+}
+
+/// Prints percentiles of every latency histogram, values are bucket lower
+/// bounds so they can be up to 12.5% low
+pub fn latency<P>(port: &mut P, reset: bool) -> std::io::Result<()>
+where
+    P: Read + Write,
+{
+    println!(
+        "{:<18} {:>10} {:>8} {:>8} {:>8} {:>8} {:>8}",
+        "Latency (us)", "Samples", "p50", "p90", "p99", "p999", "max"
+    );
+
+    for (point, name) in LATENCY_NAMES.iter().enumerate() {
+        let histogram = read_histogram(port, point as u8, reset)?;
+
+        println!(
+            "{:<18} {:>10} {:>8} {:>8} {:>8} {:>8} {:>8}",
+            name,
+            histogram.total(),
+            histogram.percentile(0.50),
+            histogram.percentile(0.90),
+            histogram.percentile(0.99),
+            histogram.percentile(0.999),
+            histogram.max()
+        );
+    }
+
+    Ok(())
+}
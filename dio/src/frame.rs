@@ -0,0 +1,77 @@
+use std::io::{Cursor, ErrorKind, Read, Write};
+
+use byteorder::{LittleEndian, ReadBytesExt};
+use speedwagon::PACKET_START;
+
+// NOTE(patrik): Diagnostic packet types only the_world and dio know about,
+// must match ExtPacketType in the_world/src/com.h
+pub const EXT_POWER: u8 = 0x80;
+pub const EXT_CAN_STATS: u8 = 0x81;
+pub const EXT_TASK_STATS: u8 = 0x82;
+pub const EXT_PROFILE: u8 = 0x83;
+pub const EXT_LATENCY: u8 = 0x84;
+pub const EXT_TRACE: u8 = 0x85;
+pub const EXT_SCHEDULE: u8 = 0x86;
+pub const EXT_BOOT: u8 = 0x87;
+pub const EXT_SUPERVISOR: u8 = 0x88;
+pub const EXT_CAPTURE: u8 = 0x89;
+pub const EXT_CONTROLS: u8 = 0x8a;
+pub const EXT_SNAPSHOT: u8 = 0x8b;
+pub const EXT_SETTINGS: u8 = 0x8c;
+
+/// Raw packet framing for the packets speedwagon doesn't cover, same wire
+/// format as the firmware (start, pid, type, length, data, checksum)
+pub fn send<W>(port: &mut W, typ: u8, data: &[u8]) -> std::io::Result<()>
+where
+    W: Write,
+{
+    let mut buf = Vec::with_capacity(data.len() + 6);
+    buf.push(PACKET_START);
+    buf.push(0);
+    buf.push(typ);
+    buf.push(data.len() as u8);
+    buf.extend_from_slice(data);
+    // TODO(patrik): Checksum, the firmware doesn't check it yet
+    buf.extend_from_slice(&[0, 0]);
+
+    port.write_all(&buf)?;
+    port.flush()
+}
+
+/// Waits for a response packet and returns the data after the error code
+pub fn read_response<R>(port: &mut R) -> std::io::Result<Vec<u8>>
+where
+    R: Read,
+{
+    while port.read_u8()? != PACKET_START {}
+
+    let _pid = port.read_u8()?;
+    let _typ = port.read_u8()?;
+    let len = port.read_u8()? as usize;
+
+    let mut data = vec![0; len];
+    port.read_exact(&mut data)?;
+
+    let _checksum = port.read_u16::<LittleEndian>()?;
+
+    match data.first() {
+        Some(0) => Ok(data.split_off(1)),
+        Some(error) => Err(std::io::Error::new(
+            ErrorKind::Other,
+            format!("Device responded with error code {}", error),
+        )),
+        None => Err(ErrorKind::InvalidData.into()),
+    }
+}
+
+pub fn request<P>(
+    port: &mut P,
+    typ: u8,
+    data: &[u8],
+) -> std::io::Result<Cursor<Vec<u8>>>
+where
+    P: Read + Write,
+{
+    send(port, typ, data)?;
+    Ok(Cursor::new(read_response(port)?))
+}
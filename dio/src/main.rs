@@ -1,16 +1,39 @@
 use std::io::{ErrorKind, Read, Write};
 use std::net::TcpStream;
 use std::os::unix::net::UnixStream;
+use std::time::Duration;
 
 use byteorder::ReadBytesExt;
 use clap::{Parser, Subcommand};
 use speedwagon::{Identity, Packet, PacketType, PACKET_START};
 
+use crate::usb::UsbPort;
+
+mod bench;
+mod capture;
+mod diag;
+mod frame;
+mod trace;
+mod usb;
+
 #[derive(Debug)]
 enum Command {
     Identify,
     Status,
     Command { cmd: u8, params: Vec<u8> },
+    Power,
+    Can,
+    Tasks,
+    Profile,
+    Latency { reset: bool },
+    Trace { path: String },
+    Schedule { reset: bool },
+    Boot,
+    Supervisor,
+    Capture(capture::Options),
+    Controls,
+    Snapshot { watch: bool },
+    Settings(diag::SettingsOp),
 }
 
 fn parse_u8(s: &str) -> Option<u8> {
@@ -27,6 +50,14 @@ fn parse_u8(s: &str) -> Option<u8> {
     }
 }
 
+fn parse_u32(s: &str) -> Option<u32> {
+    if s.len() >= 2 && &s[0..2] == "0x" {
+        u32::from_str_radix(&s[2..], 16).ok()
+    } else {
+        s.parse::<u32>().ok()
+    }
+}
+
 fn parse_cmd(cmd: &str) -> Option<Command> {
     let mut split = cmd.split(' ');
 
@@ -37,6 +68,66 @@ fn parse_cmd(cmd: &str) -> Option<Command> {
     match cmd {
         "identify" => Some(Command::Identify),
         "status" => Some(Command::Status),
+        "power" => Some(Command::Power),
+        "can" => Some(Command::Can),
+        "tasks" => Some(Command::Tasks),
+        "profile" => Some(Command::Profile),
+        "latency" => Some(Command::Latency {
+            reset: split.next() == Some("reset"),
+        }),
+        "trace" => Some(Command::Trace {
+            path: split.next().unwrap_or("trace.json").to_string(),
+        }),
+        "boot" => Some(Command::Boot),
+        "supervisor" => Some(Command::Supervisor),
+        "controls" => Some(Command::Controls),
+        "snapshot" => Some(Command::Snapshot {
+            watch: split.next() == Some("watch"),
+        }),
+        "settings" => {
+            let op = match split.next().unwrap_or("list") {
+                "list" => diag::SettingsOp::List,
+                "get" => {
+                    diag::SettingsOp::Get(parse_u32(split.next()?)? as u16)
+                }
+                "set" => {
+                    let key = parse_u32(split.next()?)? as u16;
+                    let value = match split.next() {
+                        Some(value) => Some(parse_u32(value)?),
+                        None => None,
+                    };
+
+                    diag::SettingsOp::Set(key, value)
+                }
+                "flush" => diag::SettingsOp::Flush,
+                "stats" => diag::SettingsOp::Stats,
+                _ => return None,
+            };
+
+            Some(Command::Settings(op))
+        }
+        "capture" => {
+            let rate = split.next()?.parse::<u32>().ok()?;
+            let path = split.next().unwrap_or("capture.vcd").to_string();
+            let trigger = match split.next() {
+                Some(trigger) => capture::parse_trigger(trigger)?,
+                None => 0,
+            };
+            let trigger_line = match split.next() {
+                Some(line) => parse_u8(line)?,
+                None => 0,
+            };
+
+            Some(Command::Capture(capture::Options {
+                rate,
+                path,
+                trigger,
+                trigger_line,
+            }))
+        }
+        "schedule" => Some(Command::Schedule {
+            reset: split.next() == Some("reset"),
+        }),
         "command" => {
             let cmd = split.next()?;
             let cmd = parse_u8(cmd)?;
@@ -89,6 +180,63 @@ enum Action {
         addr: String,
         cmd: String,
     },
+
+    /// Run a command over the vendor bulk interface (libusb)
+    RunUsb {
+        cmd: String,
+    },
+
+    /// Measure round-trip latency and throughput of the COM protocol
+    Bench {
+        /// Serial port, "sock:<path>", "tcp:<addr>" or "usb"
+        target: String,
+
+        #[arg(short, long, default_value_t = 115200)]
+        baudrate: u32,
+
+        /// Weighted request mix, e.g. "ping=1,status=4,identify=1"
+        #[arg(short, long, default_value = "ping")]
+        mix: String,
+
+        /// Requests per second, 0 for closed loop
+        #[arg(short, long, default_value_t = 0)]
+        rate: u32,
+
+        /// Duration in seconds
+        #[arg(short, long, default_value_t = 10)]
+        duration: u64,
+
+        /// Write the report as JSON to this file
+        #[arg(long)]
+        json: Option<String>,
+
+        /// Report the firmware's CAN interrupt to dispatch latency over
+        /// the run
+        #[arg(long)]
+        can_stats: bool,
+    },
+}
+
+trait Port: Read + Write {}
+impl<T: Read + Write> Port for T {}
+
+fn open_target(target: &str, baudrate: u32) -> Box<dyn Port> {
+    if target == "usb" {
+        Box::new(UsbPort::open().expect("Failed to open USB device"))
+    } else if let Some(path) = target.strip_prefix("sock:") {
+        Box::new(
+            UnixStream::connect(path).expect("Failed to connect to socket"),
+        )
+    } else if let Some(addr) = target.strip_prefix("tcp:") {
+        Box::new(TcpStream::connect(addr).expect("Failed to connect to TCP"))
+    } else {
+        Box::new(
+            serialport::new(target, baudrate)
+                .timeout(Duration::from_secs(1))
+                .open()
+                .expect("Failed to open serial port"),
+        )
+    }
 }
 
 fn run_debug_monitor(port: &String, baudrate: u32) {
@@ -158,6 +306,72 @@ where
             //     Err(error_code) => eprintln!("Error: {:?}", error_code),
             // }
         }
+
+        Command::Power => {
+            diag::power(port, Duration::from_secs(1)).unwrap();
+        }
+
+        Command::Can => {
+            println!("{:?}", diag::can_stats(port, false).unwrap());
+        }
+
+        Command::Tasks => {
+            diag::tasks(port).unwrap();
+        }
+
+        Command::Profile => {
+            diag::profile(port, Duration::from_secs(1)).unwrap();
+        }
+
+        Command::Latency { reset } => {
+            diag::latency(port, reset).unwrap();
+        }
+
+        Command::Trace { path } => {
+            trace::dump(port, &path).unwrap();
+        }
+
+        Command::Boot => {
+            diag::boot(port).unwrap();
+        }
+
+        Command::Capture(options) => {
+            capture::run(port, &options).unwrap();
+        }
+
+        Command::Controls => {
+            diag::controls(port).unwrap();
+        }
+
+        Command::Snapshot { watch } => {
+            diag::snapshot(port, watch).unwrap();
+        }
+
+        Command::Settings(op) => {
+            diag::settings(port, op).unwrap();
+        }
+
+        Command::Supervisor => {
+            diag::supervisor(port).unwrap();
+        }
+
+        Command::Schedule { reset } => {
+            let stats = diag::schedule(port, reset).unwrap();
+            if stats.period_us == 0 {
+                println!("Update: event driven");
+            } else {
+                println!(
+                    "Update: every {} us  {} updates  {} overruns  lateness \
+                     last {} us  max {} us",
+                    stats.period_us,
+                    stats.updates,
+                    stats.overruns,
+                    stats.last_lateness_us,
+                    stats.max_lateness_us
+                );
+            }
+            println!("Input: {} dropped edges", stats.dropped_edges);
+        }
     }
 }
 
@@ -195,5 +409,38 @@ fn main() {
                 TcpStream::connect(addr).expect("Failed to connect to TCP");
             run(&mut sock, &cmd);
         }
+
+        Action::RunUsb { cmd } => {
+            let mut port = UsbPort::open().expect("Failed to open USB device");
+            run(&mut port, &cmd);
+        }
+
+        Action::Bench {
+            target,
+            baudrate,
+            mix,
+            rate,
+            duration,
+            json,
+            can_stats,
+        } => {
+            let config = bench::Config {
+                mix: bench::parse_mix(&mix).expect("Failed to parse mix"),
+                rate,
+                duration: Duration::from_secs(duration),
+                can_stats,
+            };
+
+            let mut port = open_target(&target, baudrate);
+            let report = bench::run(&mut port, &config);
+            report.print();
+
+            if let Some(path) = json {
+                let file = std::fs::File::create(path)
+                    .expect("Failed to create report file");
+                serde_json::to_writer_pretty(file, &report)
+                    .expect("Failed to write report");
+            }
+        }
     }
 }
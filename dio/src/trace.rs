@@ -0,0 +1,262 @@
+use std::io::{Read, Write};
+
+use byteorder::{LittleEndian, ReadBytesExt};
+use serde_json::{json, Value};
+
+use crate::frame;
+
+// NOTE(patrik): Must match TraceCommand in the_world/src/com.cpp
+const TRACE_FREEZE: u8 = 0;
+const TRACE_READ: u8 = 1;
+const TRACE_TASKS: u8 = 2;
+const TRACE_RESUME: u8 = 3;
+
+// NOTE(patrik): Must match TraceEventType in the_world/src/trace.h
+const TASK_SWITCHED_IN: u8 = 1;
+const NOTIFY: u8 = 2;
+const NOTIFY_FROM_ISR: u8 = 3;
+const GPIO_IRQ: u8 = 4;
+const CAN_IRQ: u8 = 5;
+const HANDLER_BEGIN: u8 = 6;
+const HANDLER_END: u8 = 7;
+const COMMAND_BEGIN: u8 = 8;
+const COMMAND_END: u8 = 9;
+const PACKET_BEGIN: u8 = 10;
+const PACKET_END: u8 = 11;
+const CONTROL_SET: u8 = 12;
+
+const HANDLER_NAMES: [&str; 3] = ["update", "get_status", "on_can_message"];
+
+struct Event {
+    time: u32,
+    typ: u8,
+    arg: u16,
+}
+
+struct Trace {
+    cores: Vec<Vec<Event>>,
+    tasks: Vec<(u16, String)>,
+}
+
+fn read_trace<P>(port: &mut P) -> std::io::Result<Trace>
+where
+    P: Read + Write,
+{
+    let mut data = frame::request(port, frame::EXT_TRACE, &[TRACE_FREEZE])?;
+    let num_cores = data.read_u8()?;
+    let mut counts = Vec::new();
+    for _ in 0..num_cores {
+        counts.push(data.read_u16::<LittleEndian>()?);
+    }
+
+    let mut cores = Vec::new();
+    for (core, count) in counts.iter().enumerate() {
+        let mut events = Vec::new();
+
+        while events.len() < *count as usize {
+            let first = (events.len() as u16).to_le_bytes();
+            let mut data = frame::request(
+                port,
+                frame::EXT_TRACE,
+                &[TRACE_READ, core as u8, first[0], first[1]],
+            )?;
+
+            let num_events = data.read_u8()?;
+            if num_events == 0 {
+                break;
+            }
+
+            for _ in 0..num_events {
+                events.push(Event {
+                    time: data.read_u32::<LittleEndian>()?,
+                    typ: data.read_u8()?,
+                    arg: data.read_u16::<LittleEndian>()?,
+                });
+            }
+        }
+
+        cores.push(events);
+    }
+
+    let mut data = frame::request(port, frame::EXT_TRACE, &[TRACE_TASKS])?;
+    let num_tasks = data.read_u8()?;
+    let mut tasks = Vec::new();
+    for _ in 0..num_tasks {
+        let number = data.read_u16::<LittleEndian>()?;
+        let len = data.read_u8()? as usize;
+        let mut name = vec![0; len];
+        data.read_exact(&mut name)?;
+
+        tasks.push((number, String::from_utf8_lossy(&name).into_owned()));
+    }
+
+    frame::request(port, frame::EXT_TRACE, &[TRACE_RESUME])?;
+
+    Ok(Trace { cores, tasks })
+}
+
+impl Trace {
+    fn task_name(&self, number: u16) -> String {
+        self.tasks
+            .iter()
+            .find(|(n, _)| *n == number)
+            .map(|(_, name)| name.clone())
+            .unwrap_or_else(|| format!("task {}", number))
+    }
+
+    /// Newest timestamp of all cores, every other time is made relative to
+    /// it since the firmware counter wraps
+    fn reference(&self) -> Option<u32> {
+        self.cores
+            .iter()
+            .filter_map(|events| events.last())
+            .map(|event| event.time)
+            .max_by_key(|time| *time as i64)
+    }
+
+    /// Chrome trace event JSON, loads in Perfetto (ui.perfetto.dev) and
+    /// chrome://tracing. Each core gets a track for the running task and a
+    /// track for handler, command and packet spans.
+    fn to_chrome_json(&self) -> Value {
+        let reference = match self.reference() {
+            Some(reference) => reference,
+            None => return json!({ "traceEvents": [] }),
+        };
+
+        let relative =
+            |time: u32| (time.wrapping_sub(reference) as i32) as i64;
+        let start = self
+            .cores
+            .iter()
+            .flatten()
+            .map(|event| relative(event.time))
+            .min()
+            .unwrap_or(0);
+        let ts = |time: u32| relative(time) - start;
+
+        let mut out = Vec::new();
+
+        for (core, events) in self.cores.iter().enumerate() {
+            let task_tid = core * 2;
+            let span_tid = core * 2 + 1;
+
+            out.push(json!({
+                "ph": "M", "name": "thread_name", "pid": 0, "tid": task_tid,
+                "args": { "name": format!("Core {} tasks", core) },
+            }));
+            out.push(json!({
+                "ph": "M", "name": "thread_name", "pid": 0, "tid": span_tid,
+                "args": { "name": format!("Core {} handlers", core) },
+            }));
+
+            let mut events: Vec<&Event> = events.iter().collect();
+            events.sort_by_key(|event| ts(event.time));
+
+            let end = events.last().map(|event| ts(event.time)).unwrap_or(0);
+
+            let switches: Vec<&&Event> = events
+                .iter()
+                .filter(|event| event.typ == TASK_SWITCHED_IN)
+                .collect();
+            for (index, event) in switches.iter().enumerate() {
+                let begin = ts(event.time);
+                let until = switches
+                    .get(index + 1)
+                    .map(|next| ts(next.time))
+                    .unwrap_or(end);
+
+                out.push(json!({
+                    "ph": "X", "pid": 0, "tid": task_tid,
+                    "name": self.task_name(event.arg),
+                    "ts": begin, "dur": until - begin,
+                }));
+            }
+
+            for event in &events {
+                let time = ts(event.time);
+
+                let (ph, name, tid) = match event.typ {
+                    HANDLER_BEGIN | HANDLER_END => (
+                        if event.typ == HANDLER_BEGIN { "B" } else { "E" },
+                        HANDLER_NAMES
+                            .get(event.arg as usize)
+                            .copied()
+                            .unwrap_or("handler")
+                            .to_string(),
+                        span_tid,
+                    ),
+                    COMMAND_BEGIN | COMMAND_END => (
+                        if event.typ == COMMAND_BEGIN { "B" } else { "E" },
+                        format!("command {}", event.arg),
+                        span_tid,
+                    ),
+                    PACKET_BEGIN | PACKET_END => (
+                        if event.typ == PACKET_BEGIN { "B" } else { "E" },
+                        format!("packet 0x{:02x}", event.arg),
+                        span_tid,
+                    ),
+                    NOTIFY | NOTIFY_FROM_ISR => (
+                        "i",
+                        format!("notify {}", self.task_name(event.arg)),
+                        task_tid,
+                    ),
+                    GPIO_IRQ => (
+                        "i",
+                        format!(
+                            "gpio {} irq 0x{:x}",
+                            event.arg & 0xff,
+                            event.arg >> 8
+                        ),
+                        task_tid,
+                    ),
+                    CAN_IRQ => ("i", "can irq".to_string(), task_tid),
+                    CONTROL_SET => (
+                        "i",
+                        format!(
+                            "control {} {}",
+                            event.arg & 0xff,
+                            if event.arg >> 8 != 0 { "on" } else { "off" }
+                        ),
+                        task_tid,
+                    ),
+                    _ => continue,
+                };
+
+                let mut value = json!({
+                    "ph": ph, "pid": 0, "tid": tid, "name": name, "ts": time,
+                });
+                if ph == "i" {
+                    value["s"] = json!("t");
+                }
+
+                out.push(value);
+            }
+        }
+
+        json!({ "traceEvents": out, "displayTimeUnit": "ns" })
+    }
+}
+
+/// Freezes the firmware trace buffer, reads it out and writes it as a
+/// Perfetto loadable JSON file
+pub fn dump<P>(port: &mut P, path: &str) -> std::io::Result<()>
+where
+    P: Read + Write,
+{
+    let trace = read_trace(port)?;
+
+    let num_events: usize =
+        trace.cores.iter().map(|events| events.len()).sum();
+    println!(
+        "Read {} events from {} cores",
+        num_events,
+        trace.cores.len()
+    );
+
+    let file = std::fs::File::create(path)?;
+    serde_json::to_writer(file, &trace.to_chrome_json())?;
+
+    println!("Wrote {}", path);
+
+    Ok(())
+}
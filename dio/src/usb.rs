@@ -0,0 +1,120 @@
+use std::io::{ErrorKind, Read, Write};
+use std::time::Duration;
+
+use rusb::{DeviceHandle, Direction, GlobalContext, TransferType};
+
+// NOTE(patrik): Must match USB_VID / USB_PID in the_world's
+// usb_descriptors.cpp (2x CDC + Vendor)
+const USB_VID: u16 = 0xcafe;
+const USB_PID: u16 = 0x4012;
+
+const VENDOR_CLASS: u8 = 0xff;
+const READ_SIZE: usize = 512;
+const TIMEOUT: Duration = Duration::from_secs(1);
+
+/// Command channel over the vendor bulk interface, the same Speedwagon
+/// packets as the CDC port but without any tty in between
+pub struct UsbPort {
+    handle: DeviceHandle<GlobalContext>,
+    interface: u8,
+    ep_in: u8,
+    ep_out: u8,
+
+    buffer: Vec<u8>,
+    offset: usize,
+}
+
+impl UsbPort {
+    pub fn open() -> rusb::Result<Self> {
+        let mut handle = rusb::open_device_with_vid_pid(USB_VID, USB_PID)
+            .ok_or(rusb::Error::NoDevice)?;
+
+        let config = handle.device().active_config_descriptor()?;
+
+        let mut found = None;
+        for interface in config.interfaces() {
+            for desc in interface.descriptors() {
+                if desc.class_code() != VENDOR_CLASS {
+                    continue;
+                }
+
+                let mut ep_in = None;
+                let mut ep_out = None;
+                for ep in desc.endpoint_descriptors() {
+                    if ep.transfer_type() != TransferType::Bulk {
+                        continue;
+                    }
+
+                    match ep.direction() {
+                        Direction::In => ep_in = Some(ep.address()),
+                        Direction::Out => ep_out = Some(ep.address()),
+                    }
+                }
+
+                if let (Some(ep_in), Some(ep_out)) = (ep_in, ep_out) {
+                    found = Some((desc.interface_number(), ep_in, ep_out));
+                }
+            }
+        }
+
+        let (interface, ep_in, ep_out) = found.ok_or(rusb::Error::NotFound)?;
+        handle.claim_interface(interface)?;
+
+        Ok(Self {
+            handle,
+            interface,
+            ep_in,
+            ep_out,
+
+            buffer: Vec::with_capacity(READ_SIZE),
+            offset: 0,
+        })
+    }
+}
+
+impl Drop for UsbPort {
+    fn drop(&mut self) {
+        let _ = self.handle.release_interface(self.interface);
+    }
+}
+
+fn to_io_error(err: rusb::Error) -> std::io::Error {
+    match err {
+        rusb::Error::Timeout => ErrorKind::TimedOut.into(),
+        err => std::io::Error::new(ErrorKind::Other, err),
+    }
+}
+
+impl Read for UsbPort {
+    fn read(&mut self, buf: &mut [u8]) -> std::io::Result<usize> {
+        // NOTE(patrik): Bulk reads hand back whole USB packets, keep the
+        // rest around for the next call
+        while self.offset >= self.buffer.len() {
+            self.buffer.resize(READ_SIZE, 0);
+            let n = self
+                .handle
+                .read_bulk(self.ep_in, &mut self.buffer, TIMEOUT)
+                .map_err(to_io_error)?;
+            self.buffer.truncate(n);
+            self.offset = 0;
+        }
+
+        let n = buf.len().min(self.buffer.len() - self.offset);
+        buf[..n].copy_from_slice(&self.buffer[self.offset..self.offset + n]);
+        self.offset += n;
+
+        Ok(n)
+    }
+}
+
+impl Write for UsbPort {
+    fn write(&mut self, buf: &[u8]) -> std::io::Result<usize> {
+        self.handle
+            .write_bulk(self.ep_out, buf, TIMEOUT)
+            .map_err(to_io_error)
+    }
+
+    fn flush(&mut self) -> std::io::Result<()> {
+        Ok(())
+    }
+}
@@ -15,7 +15,22 @@
 #include "mcp2515/mcp2515.h"
 #include "pico/time.h"
 
-void init_system() { stdio_init_all(); }
+#include "util/button_bank.h"
+#include "util/chord.h"
+
+#include "can.h"
+#include "sleep.h"
+
+MCP2515 can0(spi0, CAN_CS_PIN, CAN_TX_PIN, CAN_RX_PIN, CAN_SCK_PIN);
+
+void init_system()
+{
+    stdio_init_all();
+
+    can0.reset();
+    can0.setBitrate(CAN_125KBPS, MCP_8MHZ);
+    can0.setNormalMode();
+}
 
 #define BUTTON0 19
 #define BUTTON1 20
@@ -25,218 +40,178 @@ void init_system() { stdio_init_all(); }
 #define CONTROL1 17
 #define CONTROL2 18
 
-struct LineState
-{
-    bool last_button_state;
-    uint32_t debounce_timer;
+// NOTE(patrik): The buttons need to be next to each other, they are read
+// as one mask
+static_assert(BUTTON1 == BUTTON0 + 1 && BUTTON2 == BUTTON0 + 2);
 
-    bool state;
-    bool last;
-};
+const uint32_t BUTTON_MASK = 0x7;
+const uint32_t BUTTON_PINS = BUTTON_MASK << BUTTON0;
 
 const int DEBOUNCE_DELAY = 50 * 1000;     // us
 const int SINGLECLICK_DELAY = 350 * 1000; // us
 const int LONGCLICK_DELAY = 500 * 1000;   // us
 
-// NOTE(patrik): https://github.com/poelstra/arduino-multi-button
-class Button
-{
-public:
-    Button() : _lastTransition(time_us_64()), _state(StateIdle), _new(false){};
+const uint32_t SAMPLE_PERIOD = 1000;             // us
+const uint32_t HEARTBEAT_PERIOD = 1000 * 1000;   // us
+const uint32_t DORMANT_DELAY = 10 * 1000 * 1000; // us
 
-    void update(bool pressed)
-    {
-        _new = false;
+// NOTE(patrik): Frame layout is in docs/devices.md (Keypad Node)
+const uint32_t KEYPAD_EVENT_ID = 0x110;
+const uint32_t KEYPAD_HEARTBEAT_ID = 0x111;
 
-        // Optimization for the most common case: nothing happening.
-        if (!pressed && _state == StateIdle)
-        {
-            return;
-        }
+const uint8_t HEARTBEAT_DORMANT = 1 << 0;
 
-        uint64_t now = time_us_64();
-        int diff = now - _lastTransition;
+// NOTE(patrik): Chords are already debounced by the recognizer, so the
+// clicks on top of them don't need to debounce again
+const ButtonTiming CHORD_TIMING = {
+    0,
+    SINGLECLICK_DELAY,
+    LONGCLICK_DELAY,
+};
 
-        State next = StateIdle;
-        switch (_state)
-        {
-            case StateIdle: next = _checkIdle(pressed, diff); break;
-            case StateDebounce: next = _checkDebounce(pressed, diff); break;
-            case StatePressed: next = _checkPressed(pressed, diff); break;
-            case StateClickUp: next = _checkClickUp(pressed, diff); break;
-            case StateClickIdle: next = _checkClickIdle(pressed, diff); break;
-            case StateSingleClick:
-                next = _checkSingleClick(pressed, diff);
-                break;
-            case StateDoubleClickDebounce:
-                next = _checkDoubleClickDebounce(pressed, diff);
-                break;
-            case StateDoubleClick:
-                next = _checkDoubleClick(pressed, diff);
-                break;
-            case StateLongClick: next = _checkLongClick(pressed, diff); break;
-            case StateOtherUp: next = _checkOtherUp(pressed, diff); break;
-        }
+// NOTE(patrik): More buttons win over fewer, the priority only needs to be
+// set for chords that should win over bigger ones
+const Chord chords[] = {
+    {0b001, 0}, // b0
+    {0b010, 0}, // b1
+    {0b100, 0}, // b2
+    {0b011, 0}, // b0 b1
+    {0b101, 0}, // b0 b2
+    {0b110, 0}, // b1 b2
+    {0b111, 0}, // b0 b1 b2
+};
 
-        if (next != _state)
-        {
-            _lastTransition = now;
-            _state = next;
-            _new = true;
-        }
-    }
+const size_t NUM_CHORDS = sizeof(chords) / sizeof(chords[0]);
 
-    bool isClick() const
-    {
-        return _new && (_state == StatePressed || _state == StateDoubleClick);
-    }
+// NOTE(patrik): Printing every event on the UART takes longer than a
+// sample period, only done when built with -DTHE_HAND_DEBUG_EVENTS
+#ifdef THE_HAND_DEBUG_EVENTS
+static const char* chord_names[NUM_CHORDS] = {
+    "b0", "b1", "b2", "b0 b1", "b0 b2", "b1 b2", "b0 b1 b2",
+};
 
-    bool isSingleClick() { return _new && _state == StateSingleClick; }
-    bool isDoubleClick() { return _new && _state == StateDoubleClick; }
-    bool isLongClick() { return _new && _state == StateLongClick; }
-    bool isReleased()
+static const char* button_event_name(ButtonEventType type)
+{
+    switch (type)
     {
-        return _new && (_state == StateClickUp || _state == StateOtherUp);
+        case ButtonEventType::Press: return "Click";
+        case ButtonEventType::Release: return "Released";
+        case ButtonEventType::SingleClick: return "Single click";
+        case ButtonEventType::DoubleClick: return "Double click";
+        case ButtonEventType::LongClick: return "Long click";
     }
 
-private:
-    enum State
-    {
-        StateIdle,
-        StateDebounce,
-        StatePressed,
+    return "Unknown";
+}
+#endif
+
+static ChordRecognizer recognizer;
+static ButtonBank chord_buttons;
 
-        StateClickUp,
-        StateClickIdle,
+struct KeypadState
+{
+    uint8_t event_seq;
+    uint8_t heartbeat_seq;
+
+    // NOTE(patrik): Wake from dormant to the first event frame out on the
+    // bus, saturates at 0xffff us
+    bool measure_wake;
+    uint64_t wake_time;
+    uint16_t last_wake_latency;
+    uint16_t max_wake_latency;
+    uint16_t num_wakes;
+};
 
-        StateSingleClick,
+static KeypadState keypad;
 
-        StateDoubleClickDebounce,
-        StateDoubleClick,
+static void put_u16(uint8_t* data, uint16_t value)
+{
+    data[0] = value & 0xff;
+    data[1] = value >> 8;
+}
 
-        StateLongClick,
-        StateOtherUp,
-    };
+static void put_u32(uint8_t* data, uint32_t value)
+{
+    put_u16(data, value & 0xffff);
+    put_u16(data + 2, value >> 16);
+}
 
-    uint64_t _lastTransition;
-    State _state;
-    bool _new;
+static bool send_frame(uint32_t can_id, uint8_t* data, size_t len)
+{
+    can_frame frame;
+    frame.can_id = can_id;
+    frame.can_dlc = len;
+    memcpy(frame.data, data, len);
 
-    State _checkIdle(bool pressed, int diff)
-    {
-        (void)diff;
-        // Wait for a key press
-        return pressed ? StateDebounce : StateIdle;
-    }
+    return can0.sendMessage(&frame) == MCP2515::ERROR_OK;
+}
 
-    State _checkDebounce(bool pressed, int diff)
-    {
-        // If released in this state: it was a glitch
-        if (!pressed)
-        {
-            return StateIdle;
-        }
-        if (diff >= DEBOUNCE_DELAY)
-        {
-            // Still pressed after debounce delay: real 'press'
-            return StatePressed;
-        }
-        return StateDebounce;
-    }
+static void send_event(const ButtonEvent& event, uint32_t lines)
+{
+    uint8_t data[8];
+    data[0] = keypad.event_seq++;
+    data[1] = event.button;
+    data[2] = (uint8_t)event.type;
+    data[3] = (uint8_t)lines;
+    put_u32(data + 4, (uint32_t)event.time);
 
-    State _checkPressed(bool pressed, int diff)
-    {
-        // If released, go wait for either a double-click, or
-        // to generate the actual SingleClick event,
-        // but first mark that the button is released.
-        if (!pressed)
-        {
-            return StateClickUp;
-        }
-        // If pressed, keep waiting to see if it's a long click
-        if (diff >= LONGCLICK_DELAY)
-        {
-            return StateLongClick;
-        }
-        return StatePressed;
-    }
+    send_frame(KEYPAD_EVENT_ID, data, sizeof(data));
 
-    State _checkClickUp(bool pressed, int diff)
+    if (keypad.measure_wake)
     {
-        (void)pressed;
-        (void)diff;
-        return StateClickIdle;
-    }
+        keypad.measure_wake = false;
 
-    State _checkClickIdle(bool pressed, int diff)
-    {
-        if (pressed)
-        {
-            return StateDoubleClickDebounce;
-        }
-        if (diff >= SINGLECLICK_DELAY)
-        {
-            return StateSingleClick;
-        }
-        return StateClickIdle;
+        uint64_t latency = time_us_64() - keypad.wake_time;
+        keypad.last_wake_latency = latency > 0xffff ? 0xffff : latency;
+        if (keypad.last_wake_latency > keypad.max_wake_latency)
+            keypad.max_wake_latency = keypad.last_wake_latency;
     }
+}
 
-    State _checkSingleClick(bool pressed, int diff)
-    {
-        (void)pressed;
-        (void)diff;
+static void send_heartbeat(uint8_t flags)
+{
+    uint8_t data[8];
+    data[0] = keypad.heartbeat_seq++;
+    data[1] = flags;
+    put_u16(data + 2, keypad.last_wake_latency);
+    put_u16(data + 4, keypad.max_wake_latency);
+    put_u16(data + 6, keypad.num_wakes);
+
+    send_frame(KEYPAD_HEARTBEAT_ID, data, sizeof(data));
+}
 
-        return StateIdle;
-    }
+static uint32_t read_lines()
+{
+    // NOTE(patrik): The buttons pull up, pressed reads low
+    return (~gpio_get_all() >> BUTTON0) & BUTTON_MASK;
+}
 
-    State _checkDoubleClickDebounce(bool pressed, int diff)
-    {
-        if (!pressed)
-        {
-            return StateClickIdle;
-        }
-        if (diff >= DEBOUNCE_DELAY)
-        {
-            return StateDoubleClick;
-        }
-        return StateDoubleClickDebounce;
-    }
+static void on_button_edge(uint gpio, uint32_t events)
+{
+    // NOTE(patrik): Only here to wake the core up from WFE
+}
 
-    State _checkDoubleClick(bool pressed, int diff)
-    {
-        (void)diff;
-        if (!pressed)
-        {
-            return StateOtherUp;
-        }
-        return StateDoubleClick;
-    }
+static void go_dormant()
+{
+    send_heartbeat(HEARTBEAT_DORMANT);
 
-    State _checkLongClick(bool pressed, int diff)
-    {
-        (void)diff;
-        if (!pressed)
-        {
-            return StateOtherUp;
-        }
-        return StateLongClick;
-    }
+    // NOTE(patrik): Let the heartbeat leave before the controller sleeps
+    sleep_ms(2);
+    can0.setSleepMode();
 
-    State _checkOtherUp(bool pressed, int diff)
-    {
-        (void)pressed;
-        (void)diff;
-        return StateIdle;
-    }
-};
+    sleep_dormant_until_low(BUTTON_PINS);
+
+    can0.setNormalMode();
+
+    keypad.wake_time = time_us_64();
+    keypad.measure_wake = true;
+    keypad.num_wakes++;
+}
 
 int main()
 {
     init_system();
 
-    // uint lines[NUM_LINES] = {19, 20, 21};
-    // LineState line_states[NUM_LINES] = {};
-
     gpio_init(BUTTON0);
     gpio_set_dir(BUTTON0, GPIO_IN);
     gpio_set_pulls(BUTTON0, true, false);
@@ -249,17 +224,16 @@ int main()
     gpio_set_dir(BUTTON2, GPIO_IN);
     gpio_set_pulls(BUTTON2, true, false);
 
-    int index = 0;
-
-    LineState line;
+    gpio_set_irq_enabled_with_callback(BUTTON0, GPIO_IRQ_EDGE_FALL, true,
+                                       on_button_edge);
+    gpio_set_irq_enabled(BUTTON1, GPIO_IRQ_EDGE_FALL, true);
+    gpio_set_irq_enabled(BUTTON2, GPIO_IRQ_EDGE_FALL, true);
 
-    Button b;
-    Button b1;
-    Button b2;
+    recognizer.init(chords, NUM_CHORDS, DEBOUNCE_DELAY, DEBOUNCE_DELAY);
 
-    bool control0 = false;
-    bool control1 = false;
-    bool control2 = false;
+    chord_buttons.init(NUM_CHORDS);
+    for (size_t i = 0; i < NUM_CHORDS; i++)
+        chord_buttons.set_timing(i, CHORD_TIMING);
 
     gpio_init(CONTROL0);
     gpio_set_dir(CONTROL0, GPIO_OUT);
@@ -270,31 +244,77 @@ int main()
     gpio_init(CONTROL2);
     gpio_set_dir(CONTROL2, GPIO_OUT);
 
+    uint64_t last_activity = time_us_64();
+    uint64_t next_heartbeat = last_activity;
+    absolute_time_t next_sample = get_absolute_time();
+
     while (true)
     {
-        bool button0 = !gpio_get(BUTTON0);
-        bool button1 = !gpio_get(BUTTON1);
-        bool button2 = !gpio_get(BUTTON2);
-
-        // b0
-        // b1
-        // b2
-        // b0 b1
-        // b0 b2
-        // b1 b2
-        // b0 b1 b2
-
-        b.update(button0 && button1 && !button2);
-        b1.update(button0 && !button1);
-        b2.update(button0 && button1 && button2);
-
-        if (b.isClick())
-            printf("Button 0\n");
-
-        if (b1.isClick())
-            printf("Button 1\n");
-
-        if (b2.isClick())
-            printf("Button 2\n");
+        uint64_t now = time_us_64();
+
+        uint32_t lines = read_lines();
+        recognizer.update(lines, now);
+
+        // NOTE(patrik): Every chord runs like a single button, that's where
+        // the clicks come from
+        ChordEvent chord;
+        while (recognizer.pop_event(&chord))
+        {
+            bool down = chord.type == ChordEventType::Press;
+            chord_buttons.edge(chord.chord, down, chord.time);
+        }
+
+        chord_buttons.update(now);
+
+        ButtonEvent event;
+        while (chord_buttons.pop_event(&event))
+        {
+            send_event(event, lines);
+#ifdef THE_HAND_DEBUG_EVENTS
+            printf("Chord %s: %s\n", chord_names[event.button],
+                   button_event_name(event.type));
+#endif
+        }
+
+        if (now >= next_heartbeat)
+        {
+            send_heartbeat(0);
+            next_heartbeat = now + HEARTBEAT_PERIOD;
+        }
+
+        // NOTE(patrik): Sample at a fixed rate while anything is going on,
+        // the debounce and click timeouts need it
+        bool idle = lines == 0 &&
+                    recognizer.next_deadline() == NO_DEADLINE &&
+                    chord_buttons.next_deadline() == NO_DEADLINE;
+        if (!idle)
+        {
+            last_activity = now;
+
+            next_sample = delayed_by_us(next_sample, SAMPLE_PERIOD);
+            sleep_until(next_sample);
+            continue;
+        }
+
+        if (now - last_activity >= DORMANT_DELAY)
+        {
+            go_dormant();
+
+            last_activity = time_us_64();
+            next_sample = get_absolute_time();
+            continue;
+        }
+
+        // NOTE(patrik): Nothing to do until a button goes down (the edge
+        // interrupt ends the WFE) or the next heartbeat
+        uint64_t wake = next_heartbeat;
+        if (last_activity + DORMANT_DELAY < wake)
+            wake = last_activity + DORMANT_DELAY;
+
+        absolute_time_t until = from_us_since_boot(wake);
+        while (read_lines() == 0 && !best_effort_wfe_or_timeout(until))
+            ;
+
+        next_sample = get_absolute_time();
     }
 }
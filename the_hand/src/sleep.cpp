@@ -0,0 +1,48 @@
+#include "sleep.h"
+
+#include "hardware/clocks.h"
+#include "hardware/gpio.h"
+#include "hardware/pll.h"
+#include "hardware/xosc.h"
+
+static const uint32_t DORMANT_CLOCK_HZ = XOSC_MHZ * 1000 * 1000;
+
+static void run_from_xosc()
+{
+    clock_configure(clk_ref, CLOCKS_CLK_REF_CTRL_SRC_VALUE_XOSC_CLKSRC, 0,
+                    DORMANT_CLOCK_HZ, DORMANT_CLOCK_HZ);
+    clock_configure(clk_sys, CLOCKS_CLK_SYS_CTRL_SRC_VALUE_CLK_REF, 0,
+                    DORMANT_CLOCK_HZ, DORMANT_CLOCK_HZ);
+    clock_configure(clk_peri, 0, CLOCKS_CLK_PERI_CTRL_AUXSRC_VALUE_CLK_SYS,
+                    DORMANT_CLOCK_HZ, DORMANT_CLOCK_HZ);
+
+    clock_stop(clk_usb);
+    clock_stop(clk_adc);
+    clock_stop(clk_rtc);
+
+    pll_deinit(pll_sys);
+    pll_deinit(pll_usb);
+}
+
+void sleep_dormant_until_low(uint32_t pin_mask)
+{
+    run_from_xosc();
+
+    for (uint32_t pin = 0; pin < NUM_BANK0_GPIOS; pin++)
+    {
+        if (pin_mask & (1u << pin))
+            gpio_set_dormant_irq_enabled(pin, GPIO_IRQ_LEVEL_LOW, true);
+    }
+
+    // NOTE(patrik): Stops here until a pin wakes the crystal up again
+    xosc_dormant();
+
+    for (uint32_t pin = 0; pin < NUM_BANK0_GPIOS; pin++)
+    {
+        if (pin_mask & (1u << pin))
+            gpio_set_dormant_irq_enabled(pin, GPIO_IRQ_LEVEL_LOW, false);
+    }
+
+    // NOTE(patrik): Same setup as boot, the PLLs and every clock divider
+    clocks_init();
+}
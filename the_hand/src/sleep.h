@@ -0,0 +1,12 @@
+#pragma once
+
+#include <stdint.h>
+
+// NOTE(patrik): Puts the RP2040 in dormant mode until one of the pins in
+// pin_mask goes low. The system clock is moved over to the crystal and the
+// PLLs are stopped before the crystal itself is stopped, everything is put
+// back to the normal clocks before this returns.
+//
+// The timer doesn't run while dormant, time_us_64() continues from where it
+// was when going to sleep.
+void sleep_dormant_until_low(uint32_t pin_mask);
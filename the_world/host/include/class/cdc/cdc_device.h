@@ -0,0 +1,19 @@
+#pragma once
+
+#include <stdint.h>
+
+// NOTE(patrik): Simulated CDC ports, the command port is a pty and the debug
+// port goes to stdout. sim_cdc_poll() stands in for tud_task(). See
+// sim/cdc.cpp
+
+uint32_t tud_cdc_n_available(uint8_t itf);
+uint32_t tud_cdc_n_read(uint8_t itf, void* buffer, uint32_t bufsize);
+// NOTE(patrik): Like TinyUSB, writes only queue what fits in the 64 byte TX
+// FIFO and return how much that was
+uint32_t tud_cdc_n_write(uint8_t itf, void const* buffer, uint32_t bufsize);
+uint32_t tud_cdc_n_write_available(uint8_t itf);
+uint32_t tud_cdc_n_write_flush(uint8_t itf);
+bool tud_cdc_n_connected(uint8_t itf);
+
+extern "C" void tud_cdc_rx_cb(uint8_t itf);
+extern "C" void tud_cdc_tx_complete_cb(uint8_t itf);
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// NOTE(patrik): The host flash is a plain array (see sim/flash.cpp), mapped
+// at XIP_BASE like the real one so reads go straight through a pointer
+
+#define FLASH_PAGE_SIZE (1u << 8)
+#define FLASH_SECTOR_SIZE (1u << 12)
+#define PICO_FLASH_SIZE_BYTES (64u * 1024)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern uint8_t sim_flash[PICO_FLASH_SIZE_BYTES];
+#define XIP_BASE ((uintptr_t)sim_flash)
+
+void flash_range_erase(uint32_t flash_offs, size_t count);
+void flash_range_program(uint32_t flash_offs, const uint8_t* data,
+                         size_t count);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stdint.h>
+
+// NOTE(patrik): Simulated GPIO bank, see sim/gpio.cpp
+
+#define NUM_BANK0_GPIOS 30
+
+typedef unsigned int uint;
+
+enum gpio_dir
+{
+    GPIO_OUT = 1,
+    GPIO_IN = 0,
+};
+
+enum gpio_irq_level
+{
+    GPIO_IRQ_LEVEL_LOW = 0x1u,
+    GPIO_IRQ_LEVEL_HIGH = 0x2u,
+    GPIO_IRQ_EDGE_FALL = 0x4u,
+    GPIO_IRQ_EDGE_RISE = 0x8u,
+};
+
+typedef void (*gpio_irq_callback_t)(uint gpio, uint32_t event_mask);
+
+void gpio_init(uint32_t gpio);
+void gpio_set_dir(uint32_t gpio, bool out);
+void gpio_pull_up(uint32_t gpio);
+void gpio_set_pulls(uint32_t gpio, bool up, bool down);
+
+bool gpio_get(uint32_t gpio);
+uint32_t gpio_get_all();
+
+void gpio_put(uint32_t gpio, bool value);
+void gpio_put_masked(uint32_t mask, uint32_t value);
+
+// NOTE(patrik): "Interrupts" fire from whoever changes the simulated input
+void gpio_set_irq_enabled_with_callback(uint32_t gpio, uint32_t event_mask,
+                                        bool enabled,
+                                        gpio_irq_callback_t callback);
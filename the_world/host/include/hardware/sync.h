@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stdint.h>
+
+// NOTE(patrik): Interrupts on the host are other threads, "disabling" them
+// takes a global recursive lock (see sim/platform.cpp)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+uint32_t save_and_disable_interrupts();
+void restore_interrupts(uint32_t status);
+
+// NOTE(patrik): The host build only ever runs on "core 0"
+uint32_t get_core_num();
+
+// NOTE(patrik): The host kernel never calls the idle hooks, nothing sleeps
+static inline void __wfi() {}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+uint64_t time_us_64();
+uint32_t time_us_32();
+
+#ifdef __cplusplus
+}
+#endif
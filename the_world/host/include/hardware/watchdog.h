@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stdint.h>
+
+// NOTE(patrik): The host build never arms the watchdog, the scratch
+// registers are plain memory and nothing survives a restart
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef volatile uint32_t io_rw_32;
+
+typedef struct
+{
+    io_rw_32 scratch[8];
+} watchdog_hw_t;
+
+extern watchdog_hw_t sim_watchdog;
+#define watchdog_hw (&sim_watchdog)
+
+void watchdog_enable(uint32_t delay_ms, bool pause_on_debug);
+void watchdog_update();
+bool watchdog_enable_caused_reboot();
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <stdint.h>
+
+// NOTE(patrik): In-memory stand-in for the pico-mcp2515 driver, frames sent
+// end up in a TX log and received frames are injected by the simulator. See
+// sim/mcp2515.cpp
+
+#define CAN_MAX_DLEN 8
+
+struct can_frame
+{
+    uint32_t can_id;
+    uint8_t can_dlc;
+    uint8_t data[CAN_MAX_DLEN];
+};
+
+struct spi_inst_t;
+#define spi0 ((spi_inst_t*)0)
+
+enum CAN_CLOCK
+{
+    MCP_20MHZ,
+    MCP_16MHZ,
+    MCP_8MHZ
+};
+
+enum CAN_SPEED
+{
+    CAN_5KBPS,
+    CAN_10KBPS,
+    CAN_20KBPS,
+    CAN_31K25BPS,
+    CAN_33KBPS,
+    CAN_40KBPS,
+    CAN_50KBPS,
+    CAN_80KBPS,
+    CAN_83K3BPS,
+    CAN_95KBPS,
+    CAN_100KBPS,
+    CAN_125KBPS,
+    CAN_200KBPS,
+    CAN_250KBPS,
+    CAN_500KBPS,
+    CAN_1000KBPS
+};
+
+class MCP2515
+{
+public:
+    enum ERROR
+    {
+        ERROR_OK = 0,
+        ERROR_FAIL = 1,
+        ERROR_ALLTXBUSY = 2,
+        ERROR_FAILINIT = 3,
+        ERROR_FAILTX = 4,
+        ERROR_NOMSG = 5
+    };
+
+    MCP2515(spi_inst_t* channel, uint8_t cs_pin, uint8_t tx_pin,
+            uint8_t rx_pin, uint8_t sck_pin, uint32_t spi_clock = 10000000);
+
+    ERROR reset();
+    ERROR setNormalMode();
+    ERROR setBitrate(CAN_SPEED can_speed, CAN_CLOCK can_clock);
+
+    ERROR sendMessage(const can_frame* frame);
+    ERROR readMessage(can_frame* frame);
+};
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifndef PICO_OK
+#    define PICO_OK 0
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// NOTE(patrik): Nothing runs from the host's flash, func is just called
+int flash_safe_execute(void (*func)(void*), void* param,
+                       uint32_t enter_exit_timeout_ms);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,22 @@
+#pragma once
+
+// NOTE(patrik): Host shim for the parts of the pico SDK the firmware uses
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdbool.h>
+
+#include "hardware/gpio.h"
+#include "hardware/timer.h"
+
+#define PICO_DEFAULT_LED_PIN 25
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void panic(const char* fmt, ...);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <chrono>
+
+// NOTE(patrik): Shared bits of the host micro benchmarks. They run the util
+// code straight on the host, no kernel, one update per simulated
+// millisecond. The inputs come from a fixed seed so every run and both sides
+// of a comparison see the same presses and bounces.
+const size_t BENCH_NUM_LINES = 16;
+const size_t BENCH_NUM_STEPS = 1 << 16;
+const uint32_t BENCH_STEP_US = 1000;
+const int BENCH_NUM_RUNS = 20;
+
+static inline uint32_t bench_random(uint32_t* state)
+{
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+// NOTE(patrik): Bit per line, set is pressed. Lines in active change every
+// 20 to 620 steps, which covers single, double and long clicks, and bounce
+// for up to 4 steps after every change. The other lines stay up.
+static inline void bench_generate(uint32_t* steps, size_t num_steps,
+                                  uint32_t active)
+{
+    uint32_t rng = 0x2545f491;
+    uint32_t level = 0;
+    uint32_t hold[BENCH_NUM_LINES] = {};
+    uint32_t bounce[BENCH_NUM_LINES] = {};
+
+    for (size_t i = 0; i < num_steps; i++)
+    {
+        uint32_t noise = 0;
+        for (size_t line = 0; line < BENCH_NUM_LINES; line++)
+        {
+            uint32_t bit = 1u << line;
+            if (!(active & bit))
+                continue;
+
+            if (hold[line] == 0)
+            {
+                level ^= bit;
+                hold[line] = 20 + bench_random(&rng) % 600;
+                bounce[line] = bench_random(&rng) % 5;
+            }
+            hold[line]--;
+
+            if (bounce[line] > 0)
+            {
+                bounce[line]--;
+                if (bench_random(&rng) & 1)
+                    noise |= bit;
+            }
+        }
+
+        steps[i] = level ^ noise;
+    }
+}
+
+// NOTE(patrik): Best of BENCH_NUM_RUNS passes over the steps, in ns per
+// step. The best run is the one the least disturbed by the rest of the
+// machine.
+template <typename F>
+static double bench_run(size_t num_steps, F func)
+{
+    double best = 0.0;
+    for (int run = 0; run < BENCH_NUM_RUNS; run++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        func();
+        auto end = std::chrono::steady_clock::now();
+
+        double ns = std::chrono::duration<double, std::nano>(end - start)
+                        .count() /
+                    (double)num_steps;
+        if (run == 0 || ns < best)
+            best = ns;
+    }
+
+    return best;
+}
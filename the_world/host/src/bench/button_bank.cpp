@@ -0,0 +1,99 @@
+#include <stdio.h>
+
+#include "bench.h"
+
+#include "util/button.h"
+#include "util/button_bank.h"
+
+// NOTE(patrik): 16 buttons in a ButtonBank against 16 Button instances, both
+// fed the same raw levels (bounces included) and both reading out every
+// click. Runs once with all 16 buttons in use and once with only one of them
+// pressed, the bank skips the idle ones.
+//
+// Usage: bench_button_bank
+
+static uint32_t steps[BENCH_NUM_STEPS];
+
+struct Clicks
+{
+    uint32_t single;
+    uint32_t doubles;
+    uint32_t longs;
+};
+
+static double run_button_bank(Clicks* clicks)
+{
+    return bench_run(BENCH_NUM_STEPS, [=] {
+        ButtonBank bank;
+        bank.init(BENCH_NUM_LINES);
+
+        Clicks counts = {};
+        uint64_t now = 0;
+        for (size_t i = 0; i < BENCH_NUM_STEPS; i++)
+        {
+            now += BENCH_STEP_US;
+            bank.update(steps[i], now);
+
+            ButtonEvent event;
+            while (bank.pop_event(&event))
+            {
+                counts.single += event.type == ButtonEventType::SingleClick;
+                counts.doubles += event.type == ButtonEventType::DoubleClick;
+                counts.longs += event.type == ButtonEventType::LongClick;
+            }
+        }
+        *clicks = counts;
+    });
+}
+
+static double run_buttons(Clicks* clicks)
+{
+    return bench_run(BENCH_NUM_STEPS, [=] {
+        Button buttons[BENCH_NUM_LINES];
+
+        Clicks counts = {};
+        uint64_t now = 0;
+        for (size_t i = 0; i < BENCH_NUM_STEPS; i++)
+        {
+            now += BENCH_STEP_US;
+            for (size_t b = 0; b < BENCH_NUM_LINES; b++)
+            {
+                Button& button = buttons[b];
+                button.update((steps[i] >> b) & 1, now);
+
+                counts.single += button.is_single_click();
+                counts.doubles += button.is_double_click();
+                counts.longs += button.is_long_click();
+            }
+        }
+        *clicks = counts;
+    });
+}
+
+static void run(const char* name, uint32_t active)
+{
+    bench_generate(steps, BENCH_NUM_STEPS, active);
+
+    Clicks bank_clicks;
+    Clicks button_clicks;
+    double bank = run_button_bank(&bank_clicks);
+    double buttons = run_buttons(&button_clicks);
+
+    printf("%-10s  %8s  %10.1f  %6u  %6u  %6u\n", name, "bank", bank,
+           bank_clicks.single, bank_clicks.doubles, bank_clicks.longs);
+    printf("%-10s  %8s  %10.1f  %6u  %6u  %6u\n", "", "buttons", buttons,
+           button_clicks.single, button_clicks.doubles, button_clicks.longs);
+}
+
+int main()
+{
+    printf("%zu buttons, %zu steps, %u us per step, best of %d runs\n\n",
+           BENCH_NUM_LINES, BENCH_NUM_STEPS, BENCH_STEP_US, BENCH_NUM_RUNS);
+    printf("%-10s  %8s  %10s  %6s  %6s  %6s\n", "pressed", "", "ns/step",
+           "single", "double", "long");
+
+    run("all 16", 0xffff);
+    run("1 of 16", 0x0001);
+
+    return 0;
+}
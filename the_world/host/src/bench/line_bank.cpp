@@ -0,0 +1,132 @@
+#include <stdio.h>
+
+#include "bench.h"
+
+#include "util/button.h"
+#include "util/line_bank.h"
+
+#include "sim/sim.h"
+
+#include <hardware/gpio.h>
+
+// NOTE(patrik): LineBank against what devices did before it, one Button per
+// line fed from its own gpio_get(). Both read the lines through the simulated
+// GPIO bank. Setting the simulated inputs for a step costs the same for
+// both, it's measured on its own and taken off.
+//
+// Usage: bench_line_bank
+
+static uint32_t steps[BENCH_NUM_STEPS];
+static uint32_t pins[BENCH_NUM_LINES];
+
+static volatile uint32_t sink;
+
+static uint32_t last_input = 0;
+
+static void set_inputs(uint32_t pressed)
+{
+    // NOTE(patrik): Active low, only touch the lines that changed
+    uint32_t changed = pressed ^ last_input;
+    for (size_t i = 0; i < BENCH_NUM_LINES; i++)
+    {
+        if (changed & (1u << i))
+            sim_gpio_set_input(pins[i], !(pressed & (1u << i)));
+    }
+
+    last_input = pressed;
+}
+
+static void reset_inputs()
+{
+    set_inputs(0);
+}
+
+static double run_baseline()
+{
+    return bench_run(BENCH_NUM_STEPS, [] {
+        reset_inputs();
+        uint32_t acc = 0;
+        for (size_t i = 0; i < BENCH_NUM_STEPS; i++)
+        {
+            set_inputs(steps[i]);
+            acc ^= steps[i];
+        }
+        sink = acc;
+    });
+}
+
+static double run_line_bank(size_t num_lines, uint32_t* num_presses)
+{
+    return bench_run(BENCH_NUM_STEPS, [=] {
+        reset_inputs();
+        LineBank bank;
+        bank.init(pins, num_lines);
+
+        uint32_t presses = 0;
+        for (size_t i = 0; i < BENCH_NUM_STEPS; i++)
+        {
+            set_inputs(steps[i]);
+            bank.sample();
+            presses += __builtin_popcount(bank.pressed());
+        }
+        *num_presses = presses;
+    });
+}
+
+static double run_buttons(size_t num_lines, uint32_t* num_presses)
+{
+    return bench_run(BENCH_NUM_STEPS, [=] {
+        reset_inputs();
+        Button buttons[BENCH_NUM_LINES];
+
+        uint32_t presses = 0;
+        uint64_t now = 0;
+        for (size_t i = 0; i < BENCH_NUM_STEPS; i++)
+        {
+            set_inputs(steps[i]);
+            now += BENCH_STEP_US;
+            for (size_t line = 0; line < num_lines; line++)
+            {
+                buttons[line].update(!gpio_get(pins[line]), now);
+                presses += buttons[line].is_click();
+            }
+        }
+        *num_presses = presses;
+    });
+}
+
+int main()
+{
+    for (size_t i = 0; i < BENCH_NUM_LINES; i++)
+    {
+        pins[i] = (uint32_t)i;
+        gpio_init(pins[i]);
+        gpio_set_dir(pins[i], GPIO_IN);
+        sim_gpio_set_input(pins[i], true);
+    }
+
+    printf("%zu steps, %u us per step, best of %d runs\n", BENCH_NUM_STEPS,
+           BENCH_STEP_US, BENCH_NUM_RUNS);
+    printf("ns per step, setting the inputs taken off\n\n");
+    printf("%5s  %10s  %10s  %10s  %10s\n", "lines", "line bank", "buttons",
+           "bank press", "btn press");
+
+    const size_t line_counts[] = {1, 4, 16};
+    for (size_t num_lines : line_counts)
+    {
+        uint32_t active = num_lines < 32 ? (1u << num_lines) - 1 : ~0u;
+        bench_generate(steps, BENCH_NUM_STEPS, active);
+
+        double baseline = run_baseline();
+
+        uint32_t bank_presses = 0;
+        uint32_t button_presses = 0;
+        double bank = run_line_bank(num_lines, &bank_presses) - baseline;
+        double buttons = run_buttons(num_lines, &button_presses) - baseline;
+
+        printf("%5zu  %10.1f  %10.1f  %10u  %10u\n", num_lines, bank, buttons,
+               bank_presses, button_presses);
+    }
+
+    return 0;
+}
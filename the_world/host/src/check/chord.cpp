@@ -0,0 +1,106 @@
+#include <stdio.h>
+
+#include <initializer_list>
+
+#include "util/chord.h"
+
+// NOTE(patrik): Host checks for ChordRecognizer, each case feeds the lines
+// one sample per ms and compares the events that come out. Exits non-zero
+// when a case fails.
+//
+// Usage: check_chord
+
+const uint32_t SETTLE_US = 50 * 1000;
+const uint32_t RELEASE_US = 50 * 1000;
+
+// NOTE(patrik): Same table as the_hand
+const Chord chords[] = {
+    {0b001, 0}, // b0
+    {0b010, 0}, // b1
+    {0b100, 0}, // b2
+    {0b011, 0}, // b0 b1
+    {0b101, 0}, // b0 b2
+    {0b110, 0}, // b1 b2
+    {0b111, 0}, // b0 b1 b2
+};
+
+const uint8_t CHORD_B0 = 0;
+const uint8_t CHORD_B1 = 1;
+const uint8_t CHORD_B0_B1 = 3;
+
+struct Span
+{
+    uint32_t lines;
+    uint32_t ms; // How long lines are held
+};
+
+struct Expected
+{
+    uint8_t chord;
+    ChordEventType type;
+};
+
+static int num_failed = 0;
+
+static void check(const char* name, std::initializer_list<Span> spans,
+                  std::initializer_list<Expected> expected)
+{
+    ChordRecognizer recognizer;
+    recognizer.init(chords, sizeof(chords) / sizeof(chords[0]), SETTLE_US,
+                    RELEASE_US);
+
+    uint64_t now = 0;
+    for (const Span& span : spans)
+    {
+        for (uint32_t i = 0; i < span.ms; i++)
+        {
+            recognizer.update(span.lines, now);
+            now += 1000;
+        }
+    }
+
+    bool ok = true;
+    const Expected* next = expected.begin();
+
+    ChordEvent event;
+    while (recognizer.pop_event(&event))
+    {
+        if (next == expected.end() || event.chord != next->chord ||
+            event.type != next->type)
+        {
+            ok = false;
+            break;
+        }
+        next++;
+    }
+
+    if (next != expected.end())
+        ok = false;
+
+    printf("%-24s %s\n", name, ok ? "ok" : "FAILED");
+    if (!ok)
+        num_failed++;
+}
+
+int main()
+{
+    // NOTE(patrik): The idle span at the end lets the chord release
+    check("single", {{0b001, 200}, {0, 100}},
+          {{CHORD_B0, ChordEventType::Press},
+           {CHORD_B0, ChordEventType::Release}});
+
+    check("pair", {{0b001, 20}, {0b011, 200}, {0, 100}},
+          {{CHORD_B0_B1, ChordEventType::Press},
+           {CHORD_B0_B1, ChordEventType::Release}});
+
+    // NOTE(patrik): b0 goes up as b1 goes down, both inside the settle
+    // window. They were never held together, so no "b0 b1".
+    check("roll over", {{0b001, 20}, {0b010, 200}, {0, 100}},
+          {{CHORD_B1, ChordEventType::Press},
+           {CHORD_B1, ChordEventType::Release}});
+
+    // NOTE(patrik): Let go of before the window ran out
+    check("glitch", {{0b001, 10}, {0, 100}}, {});
+
+    return num_failed ? 1 : 0;
+}
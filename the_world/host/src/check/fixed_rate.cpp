@@ -0,0 +1,42 @@
+#include <stdio.h>
+
+#include "util/fixed_rate.h"
+
+// NOTE(patrik): Host checks for the tick schedule of devices with an
+// update_period, no device uses one yet so this is all that runs it. Exits
+// non-zero when a case fails.
+//
+// Usage: check_fixed_rate
+
+const uint32_t PERIOD = 1000;
+
+static int num_failed = 0;
+
+static void check(const char* name, uint64_t tick, uint64_t now,
+                  uint64_t expected_next, uint32_t expected_missed)
+{
+    uint32_t missed;
+    uint64_t next = fixed_rate_next(tick, now, PERIOD, &missed);
+
+    bool ok = next == expected_next && missed == expected_missed;
+    printf("%-24s %s\n", name, ok ? "ok" : "FAILED");
+    if (!ok)
+        num_failed++;
+}
+
+int main()
+{
+    check("on time", 0, 300, 1000, 0);
+    check("just in time", 0, 999, 1000, 0);
+
+    // NOTE(patrik): The next tick is due as the update finishes
+    check("at next tick", 0, 1000, 2000, 1);
+    check("overran one", 0, 1500, 2000, 1);
+    check("overran several", 0, 3500, 4000, 3);
+
+    // NOTE(patrik): Stays on the grid of the first tick
+    check("off grid", 7, 2600, 3007, 2);
+    check("late start", 5000, 5200, 6000, 0);
+
+    return num_failed ? 1 : 0;
+}
@@ -0,0 +1,113 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+
+#include "com.h"
+#include "can.h"
+#include "device.h"
+#include "settings.h"
+
+#include "util/serial_number.h"
+
+#include "sim/sim.h"
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+// NOTE(patrik): Host build of the firmware, the device runs on top of the
+// FreeRTOS POSIX port with simulated GPIO, CDC (pty), MCP2515 and flash.
+//
+// Usage: the_world_<device> [--can-rate <frames per second>]
+//                           [--flash <file>]
+//
+// Without --flash the settings start out empty and are lost on exit.
+
+static uint32_t can_rate = 0;
+static const char* flash_path = nullptr;
+
+// NOTE(patrik): Same ordering as the firmware (see src/main.cpp), the sim
+// thread sits on top since it stands in for the hardware
+const UBaseType_t SIM_THREAD_PRIORITY = tskIDLE_PRIORITY + 4;
+const UBaseType_t UPDATE_THREAD_PRIORITY = tskIDLE_PRIORITY + 3;
+const UBaseType_t USB_THREAD_PRIORITY = tskIDLE_PRIORITY + 2;
+const UBaseType_t COM_THREAD_PRIORITY = tskIDLE_PRIORITY + 1;
+
+void usb_thread(void* ptr)
+{
+    while (true)
+    {
+        sim_cdc_poll();
+        vTaskDelay(1);
+    }
+}
+
+void sim_thread(void* ptr)
+{
+    // NOTE(patrik): Generates CAN traffic so the receive path can be
+    // benchmarked without a bus
+    TickType_t period = configTICK_RATE_HZ / can_rate;
+    if (period == 0)
+        period = 1;
+
+    TickType_t last_wake = xTaskGetTickCount();
+    uint8_t counter = 0;
+
+    while (true)
+    {
+        uint8_t data[] = {counter++};
+        sim_can_inject(0x200, data, sizeof(data));
+
+        vTaskDelayUntil(&last_wake, period);
+    }
+}
+
+static TaskHandle_t usb_thread_handle;
+static TaskHandle_t sim_thread_handle;
+static TaskHandle_t update_thread_handle;
+static TaskHandle_t com_thread_handle;
+
+static DeviceContext device_context;
+
+int main(int argc, char** argv)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--can-rate") == 0 && i + 1 < argc)
+            can_rate = strtoul(argv[++i], nullptr, 10);
+        else if (strcmp(argv[i], "--flash") == 0 && i + 1 < argc)
+            flash_path = argv[++i];
+    }
+
+    serial_number_init();
+
+    if (!sim_cdc_init())
+    {
+        fprintf(stderr, "Failed to create the command pty\n");
+        return -1;
+    }
+
+    fprintf(stderr, "%s: command port on %s\n", spec.name,
+            sim_cdc_port_name());
+
+    // NOTE(patrik): Same order as the firmware, settings first, then controls
+    // before CAN
+    sim_flash_init(flash_path);
+    settings_init();
+
+    init_device(&device_context);
+    can_init();
+
+    xTaskCreate(usb_thread, "USB Thread", configMINIMAL_STACK_SIZE, nullptr,
+                USB_THREAD_PRIORITY, &usb_thread_handle);
+    if (can_rate > 0)
+        xTaskCreate(sim_thread, "Sim Thread", configMINIMAL_STACK_SIZE,
+                    nullptr, SIM_THREAD_PRIORITY, &sim_thread_handle);
+    xTaskCreate(update_thread, "Update Thread", configMINIMAL_STACK_SIZE,
+                &device_context, UPDATE_THREAD_PRIORITY, &update_thread_handle);
+    xTaskCreate(com_thread, "COM Thread", configMINIMAL_STACK_SIZE,
+                &device_context, COM_THREAD_PRIORITY, &com_thread_handle);
+
+    vTaskStartScheduler();
+}
@@ -0,0 +1,17 @@
+#include "capture.h"
+
+// NOTE(patrik): There is no PIO on the host, captures never start
+
+uint32_t capture_start(uint32_t rate, CaptureTrigger trigger,
+                       uint8_t trigger_line)
+{
+    return 0;
+}
+
+void capture_stop() {}
+
+CaptureState capture_state() { return CaptureState::Idle; }
+uint32_t capture_rate() { return 0; }
+
+uint32_t capture_count() { return 0; }
+uint16_t capture_get(uint32_t index) { return 0; }
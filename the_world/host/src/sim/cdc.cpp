@@ -0,0 +1,154 @@
+#include "sim.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <class/cdc/cdc_device.h>
+
+#include "common.h"
+#include "util/spsc_queue.h"
+
+// NOTE(patrik): The command port is the master side of a pty, point dio (or
+// anything else that talks to a serial port) at the slave side
+
+static int cmd_fd = -1;
+
+// NOTE(patrik): Filled by sim_cdc_poll() (the "USB" thread) and drained by
+// the COM thread
+static SpscQueue<uint8_t, 1024> rx_buffer;
+
+// NOTE(patrik): Same size as CFG_TUD_CDC_TX_BUFSIZE, writes only queue what
+// fits like TinyUSB's FIFO and sim_cdc_poll() sends it
+static SpscQueue<uint8_t, 64> tx_buffer;
+
+static void write_all(const uint8_t* data, uint32_t len)
+{
+    uint32_t written = 0;
+    while (written < len)
+    {
+        ssize_t n = write(cmd_fd, data + written, len - written);
+        if (n < 0)
+        {
+            if (errno == EAGAIN || errno == EINTR)
+                continue;
+
+            break;
+        }
+
+        written += n;
+    }
+}
+
+bool sim_cdc_init()
+{
+    cmd_fd = posix_openpt(O_RDWR | O_NOCTTY);
+    if (cmd_fd < 0)
+        return false;
+
+    if (grantpt(cmd_fd) != 0 || unlockpt(cmd_fd) != 0)
+        return false;
+
+    // NOTE(patrik): No line discipline, the protocol is binary
+    termios tio;
+    tcgetattr(cmd_fd, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(cmd_fd, TCSANOW, &tio);
+
+    fcntl(cmd_fd, F_SETFL, fcntl(cmd_fd, F_GETFL) | O_NONBLOCK);
+
+    return true;
+}
+
+const char* sim_cdc_port_name() { return ptsname(cmd_fd); }
+
+void sim_cdc_poll()
+{
+    uint8_t buffer[256];
+
+    bool received = false;
+    while (true)
+    {
+        ssize_t n = read(cmd_fd, buffer, sizeof(buffer));
+        if (n <= 0)
+            break;
+
+        // TODO(patrik): Drops data if the COM thread falls 1024 bytes
+        // behind, the real CDC FIFO would NAK instead
+        for (ssize_t i = 0; i < n; i++)
+            rx_buffer.push(buffer[i]);
+
+        received = true;
+    }
+
+    if (received)
+        tud_cdc_rx_cb(PORT_CMD);
+
+    uint32_t len = 0;
+    while (len < sizeof(buffer) && tx_buffer.pop(&buffer[len]))
+        len++;
+
+    if (len > 0)
+    {
+        write_all(buffer, len);
+        tud_cdc_tx_complete_cb(PORT_CMD);
+    }
+}
+
+uint32_t tud_cdc_n_available(uint8_t itf)
+{
+    if (itf != PORT_CMD)
+        return 0;
+
+    return rx_buffer.size();
+}
+
+uint32_t tud_cdc_n_read(uint8_t itf, void* buffer, uint32_t bufsize)
+{
+    if (itf != PORT_CMD)
+        return 0;
+
+    uint8_t* data = (uint8_t*)buffer;
+
+    uint32_t n = 0;
+    while (n < bufsize && rx_buffer.pop(data + n))
+        n++;
+
+    return n;
+}
+
+uint32_t tud_cdc_n_write(uint8_t itf, void const* buffer, uint32_t bufsize)
+{
+    if (itf == PORT_DEBUG)
+        return fwrite(buffer, 1, bufsize, stdout);
+
+    const uint8_t* data = (const uint8_t*)buffer;
+
+    uint32_t n = 0;
+    while (n < bufsize && tx_buffer.push(data[n]))
+        n++;
+
+    return n;
+}
+
+uint32_t tud_cdc_n_write_available(uint8_t itf)
+{
+    if (itf == PORT_DEBUG)
+        return UINT32_MAX;
+
+    return 64 - tx_buffer.size();
+}
+
+bool tud_cdc_n_connected(uint8_t itf) { return cmd_fd >= 0; }
+
+uint32_t tud_cdc_n_write_flush(uint8_t itf)
+{
+    if (itf == PORT_DEBUG)
+        fflush(stdout);
+
+    return 0;
+}
@@ -0,0 +1,72 @@
+#include <stdio.h>
+#include <string.h>
+
+#include <hardware/flash.h>
+#include <pico/flash.h>
+
+#include "sim/sim.h"
+
+uint8_t sim_flash[PICO_FLASH_SIZE_BYTES];
+
+static const char* backing_path = nullptr;
+
+// NOTE(patrik): The whole flash goes back to the file after every change,
+// it's small and only written when the settings flush
+static void save()
+{
+    if (!backing_path)
+        return;
+
+    FILE* file = fopen(backing_path, "wb");
+    if (!file)
+        return;
+
+    fwrite(sim_flash, 1, sizeof(sim_flash), file);
+    fclose(file);
+}
+
+void sim_flash_init(const char* path)
+{
+    memset(sim_flash, 0xff, sizeof(sim_flash));
+
+    backing_path = path;
+    if (!backing_path)
+        return;
+
+    FILE* file = fopen(backing_path, "rb");
+    if (!file)
+        return;
+
+    fread(sim_flash, 1, sizeof(sim_flash), file);
+    fclose(file);
+}
+
+void flash_range_erase(uint32_t flash_offs, size_t count)
+{
+    if (flash_offs % FLASH_SECTOR_SIZE || count % FLASH_SECTOR_SIZE ||
+        flash_offs + count > sizeof(sim_flash))
+        return;
+
+    memset(sim_flash + flash_offs, 0xff, count);
+    save();
+}
+
+void flash_range_program(uint32_t flash_offs, const uint8_t* data,
+                         size_t count)
+{
+    if (flash_offs % FLASH_PAGE_SIZE || count % FLASH_PAGE_SIZE ||
+        flash_offs + count > sizeof(sim_flash))
+        return;
+
+    // NOTE(patrik): Like NOR flash, programming only clears bits
+    for (size_t i = 0; i < count; i++)
+        sim_flash[flash_offs + i] &= data[i];
+    save();
+}
+
+int flash_safe_execute(void (*func)(void*), void* param,
+                       uint32_t enter_exit_timeout_ms)
+{
+    func(param);
+    return PICO_OK;
+}
@@ -0,0 +1,103 @@
+#include "sim.h"
+
+#include <atomic>
+
+#include <hardware/gpio.h>
+
+// NOTE(patrik): The whole bank is just a couple of bit masks
+
+static std::atomic<uint32_t> gpio_dir{0};
+static std::atomic<uint32_t> gpio_in{0};
+static std::atomic<uint32_t> gpio_out{0};
+static std::atomic<uint32_t> gpio_pull_ups{0};
+
+static std::atomic<uint32_t> irq_rise{0};
+static std::atomic<uint32_t> irq_fall{0};
+static gpio_irq_callback_t irq_callback = nullptr;
+
+void gpio_init(uint32_t gpio)
+{
+    gpio_dir &= ~(1u << gpio);
+    gpio_out &= ~(1u << gpio);
+}
+
+void gpio_set_dir(uint32_t gpio, bool out)
+{
+    if (out)
+        gpio_dir |= 1u << gpio;
+    else
+        gpio_dir &= ~(1u << gpio);
+}
+
+void gpio_pull_up(uint32_t gpio) { gpio_set_pulls(gpio, true, false); }
+
+void gpio_set_pulls(uint32_t gpio, bool up, bool down)
+{
+    if (up)
+    {
+        gpio_pull_ups |= 1u << gpio;
+        gpio_in |= 1u << gpio;
+    }
+    else
+    {
+        gpio_pull_ups &= ~(1u << gpio);
+    }
+}
+
+bool gpio_get(uint32_t gpio) { return (gpio_get_all() >> gpio) & 1; }
+
+uint32_t gpio_get_all()
+{
+    uint32_t dir = gpio_dir;
+    return (gpio_in & ~dir) | (gpio_out & dir);
+}
+
+void gpio_put(uint32_t gpio, bool value)
+{
+    if (value)
+        gpio_out |= 1u << gpio;
+    else
+        gpio_out &= ~(1u << gpio);
+}
+
+void gpio_put_masked(uint32_t mask, uint32_t value)
+{
+    uint32_t out = gpio_out;
+    while (!gpio_out.compare_exchange_weak(out, (out & ~mask) | (value & mask)))
+        ;
+}
+
+void gpio_set_irq_enabled_with_callback(uint32_t gpio, uint32_t event_mask,
+                                        bool enabled,
+                                        gpio_irq_callback_t callback)
+{
+    irq_callback = callback;
+
+    uint32_t bit = 1u << gpio;
+    if (enabled && (event_mask & GPIO_IRQ_EDGE_RISE))
+        irq_rise |= bit;
+    else
+        irq_rise &= ~bit;
+
+    if (enabled && (event_mask & GPIO_IRQ_EDGE_FALL))
+        irq_fall |= bit;
+    else
+        irq_fall &= ~bit;
+}
+
+void sim_gpio_set_input(uint32_t gpio, bool level)
+{
+    uint32_t bit = 1u << gpio;
+    uint32_t old = level ? gpio_in.fetch_or(bit) : gpio_in.fetch_and(~bit);
+
+    bool was = (old & bit) != 0;
+    if (was == level || !irq_callback)
+        return;
+
+    if (level && (irq_rise & bit))
+        irq_callback(gpio, GPIO_IRQ_EDGE_RISE);
+    else if (!level && (irq_fall & bit))
+        irq_callback(gpio, GPIO_IRQ_EDGE_FALL);
+}
+
+bool sim_gpio_get_output(uint32_t gpio) { return (gpio_out >> gpio) & 1; }
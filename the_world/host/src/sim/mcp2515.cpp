@@ -0,0 +1,75 @@
+#include "sim.h"
+
+#include <atomic>
+#include <string.h>
+
+#include <mcp2515/mcp2515.h>
+
+#include "can.h"
+#include "util/spsc_queue.h"
+
+// NOTE(patrik): In-memory controller, the simulator is the only producer of
+// received frames and can_update() the only consumer
+
+static SpscQueue<can_frame, 64> rx_frames;
+static std::atomic<size_t> num_sent{0};
+
+MCP2515::MCP2515(spi_inst_t* channel, uint8_t cs_pin, uint8_t tx_pin,
+                 uint8_t rx_pin, uint8_t sck_pin, uint32_t spi_clock)
+{
+}
+
+MCP2515::ERROR MCP2515::reset() { return ERROR_OK; }
+MCP2515::ERROR MCP2515::setNormalMode() { return ERROR_OK; }
+
+MCP2515::ERROR MCP2515::setBitrate(CAN_SPEED can_speed, CAN_CLOCK can_clock)
+{
+    return ERROR_OK;
+}
+
+MCP2515::ERROR MCP2515::sendMessage(const can_frame* frame)
+{
+    if (frame->can_dlc > CAN_MAX_DLEN)
+        return ERROR_FAILTX;
+
+    num_sent++;
+    return ERROR_OK;
+}
+
+MCP2515::ERROR MCP2515::readMessage(can_frame* frame)
+{
+    if (!rx_frames.pop(frame))
+    {
+        sim_gpio_set_input(CAN_INT_PIN, true);
+
+        // NOTE(patrik): A frame might have been injected in between
+        if (!rx_frames.empty())
+            sim_gpio_set_input(CAN_INT_PIN, false);
+
+        return ERROR_NOMSG;
+    }
+
+    return ERROR_OK;
+}
+
+bool sim_can_inject(uint32_t can_id, const uint8_t* data, size_t len)
+{
+    if (len > CAN_MAX_DLEN)
+        return false;
+
+    can_frame frame = {};
+    frame.can_id = can_id;
+    frame.can_dlc = (uint8_t)len;
+    if (data && len > 0)
+        memcpy(frame.data, data, len);
+
+    if (!rx_frames.push(frame))
+        return false;
+
+    // NOTE(patrik): Like the real thing INT stays low until the frames are
+    // read out
+    sim_gpio_set_input(CAN_INT_PIN, false);
+    return true;
+}
+
+size_t sim_can_num_sent() { return num_sent; }
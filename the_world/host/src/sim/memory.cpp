@@ -0,0 +1,13 @@
+#include "memory.h"
+
+// NOTE(patrik): The host build allocates through the system malloc
+// (heap_3), there is no fixed budget to report
+MemoryStats memory_stats()
+{
+    MemoryStats stats;
+    stats.free_heap = 0;
+    stats.min_free_heap = 0;
+    stats.free_ram = 0;
+
+    return stats;
+}
@@ -0,0 +1,58 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <mutex>
+
+#include <pico/stdlib.h>
+#include <pico/unique_id.h>
+#include <hardware/sync.h>
+#include <hardware/watchdog.h>
+
+static uint64_t now_us()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+// NOTE(patrik): Like the RP2040 timer, start counting at "reset"
+static const uint64_t start_time = now_us();
+
+uint64_t time_us_64() { return now_us() - start_time; }
+uint32_t time_us_32() { return (uint32_t)time_us_64(); }
+
+void panic(const char* fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    vfprintf(stderr, fmt, args);
+    va_end(args);
+
+    abort();
+}
+
+void pico_get_unique_board_id(pico_unique_board_id_t* id_out)
+{
+    for (int i = 0; i < PICO_UNIQUE_BOARD_ID_SIZE_BYTES; i++)
+        id_out->id[i] = 0xa0 + i;
+}
+
+static std::recursive_mutex interrupt_lock;
+
+uint32_t save_and_disable_interrupts()
+{
+    interrupt_lock.lock();
+    return 0;
+}
+
+void restore_interrupts(uint32_t status) { interrupt_lock.unlock(); }
+
+uint32_t get_core_num() { return 0; }
+
+watchdog_hw_t sim_watchdog;
+
+void watchdog_enable(uint32_t delay_ms, bool pause_on_debug) {}
+void watchdog_update() {}
+bool watchdog_enable_caused_reboot() { return false; }
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// NOTE(patrik): Hooks into the simulated hardware, used by the host main to
+// drive inputs and watch outputs
+
+// GPIO
+void sim_gpio_set_input(uint32_t gpio, bool level);
+bool sim_gpio_get_output(uint32_t gpio);
+
+// CDC
+bool sim_cdc_init();
+const char* sim_cdc_port_name();
+void sim_cdc_poll();
+
+// Flash, loaded from path (when it exists) and written back to it on every
+// change, nullptr keeps it in memory only
+void sim_flash_init(const char* path);
+
+// CAN
+bool sim_can_inject(uint32_t can_id, const uint8_t* data, size_t len);
+size_t sim_can_num_sent();
@@ -43,10 +43,26 @@
 
 /* Scheduler Related */
 #define configUSE_PREEMPTION 1
-#define configUSE_TICKLESS_IDLE 0
-#define configUSE_IDLE_HOOK 0
+/* Both cores by default, the SMP option in CMakeLists.txt turns it off */
+#ifndef USE_SMP
+#    define USE_SMP 1
+#endif
+
+/* The RP2040 SMP port has no tickless idle. The idle tasks sleep with WFI
+from the idle hooks instead (see power_idle), the tick still wakes core 0
+every ms but both cores stay halted between interrupts */
+#if USE_SMP
+#    define configUSE_TICKLESS_IDLE 0
+#    define configUSE_IDLE_HOOK 1
+#    define configUSE_MINIMAL_IDLE_HOOK 1
+#    define configUSE_PASSIVE_IDLE_HOOK 1
+#else
+#    define configUSE_TICKLESS_IDLE 1
+#    define configUSE_IDLE_HOOK 0
+#endif
+#define configEXPECTED_IDLE_TIME_BEFORE_SLEEP 2
 #define configUSE_TICK_HOOK 1
-#define configTICK_RATE_HZ ((TickType_t)20000)
+#define configTICK_RATE_HZ ((TickType_t)1000)
 #define configMAX_PRIORITIES 32
 #define configMINIMAL_STACK_SIZE (configSTACK_DEPTH_TYPE)256
 #define configUSE_16_BIT_TICKS 0
@@ -70,9 +86,12 @@
 #define configMESSAGE_BUFFER_LENGTH_TYPE size_t
 
 /* Memory allocation related definitions. */
-#define configSUPPORT_STATIC_ALLOCATION 0
+/* Every task is allocated statically (see main.cpp), the heap is only left
+for whatever the SDK or TinyUSB still allocate. Check the TaskStats packet
+(min free heap) before shrinking it further. */
+#define configSUPPORT_STATIC_ALLOCATION 1
 #define configSUPPORT_DYNAMIC_ALLOCATION 1
-#define configTOTAL_HEAP_SIZE (64 * 1024)
+#define configTOTAL_HEAP_SIZE (4 * 1024)
 #define configAPPLICATION_ALLOCATED_HEAP 0
 
 /* Hook function related definitions. */
@@ -81,7 +100,14 @@
 #define configUSE_DAEMON_TASK_STARTUP_HOOK 0
 
 /* Run time and task stats gathering related definitions. */
-#define configGENERATE_RUN_TIME_STATS 0
+/* Run time is counted in us straight from the RP2040 timer, the 32 bit
+counter wraps after ~71 minutes so readers should use deltas */
+#define configGENERATE_RUN_TIME_STATS 1
+#ifndef __ASSEMBLER__
+#    include "hardware/timer.h"
+#endif
+#define portCONFIGURE_TIMER_FOR_RUN_TIME_STATS()
+#define portGET_RUN_TIME_COUNTER_VALUE() time_us_32()
 #define configUSE_TRACE_FACILITY 1
 #define configUSE_STATS_FORMATTING_FUNCTIONS 0
 
@@ -93,7 +119,7 @@
 #define configUSE_TIMERS 1
 #define configTIMER_TASK_PRIORITY (configMAX_PRIORITIES - 1)
 #define configTIMER_QUEUE_LENGTH 10
-#define configTIMER_TASK_STACK_DEPTH 1024
+#define configTIMER_TASK_STACK_DEPTH 256
 
 /* Interrupt nesting behaviour configuration. */
 /*
@@ -104,14 +130,50 @@ processor and application]
 */
 
 /* SMP port only */
-#define configNUM_CORES 1
-#define configTICK_CORE 1
+#if USE_SMP
+#    define configNUM_CORES 2
+#    define configUSE_CORE_AFFINITY 1
+#else
+#    define configNUM_CORES 1
+#endif
+/* The tick interrupt stays on the USB/COM core, away from CAN */
+#define configTICK_CORE 0
 #define configRUN_MULTIPLE_PRIORITIES 1
 
 /* RP2040 specific */
 #define configSUPPORT_PICO_SYNC_INTEROP 1
 #define configSUPPORT_PICO_TIME_INTEROP 1
 
+/* Low power, the port sleeps with WFI between these in tickless idle (see
+power.cpp) */
+#ifndef __ASSEMBLER__
+#    include <stdint.h>
+#    ifdef __cplusplus
+extern "C" {
+#    endif
+void power_pre_sleep(uint32_t expected_idle_time);
+void power_post_sleep(uint32_t expected_idle_time);
+#    ifdef __cplusplus
+}
+#    endif
+#endif
+
+#define configPRE_SLEEP_PROCESSING(x) power_pre_sleep(x)
+#define configPOST_SLEEP_PROCESSING(x) power_post_sleep(x)
+
+/* Trace recorder (see trace.h), pxCurrentTCB and pxTCB are the kernel's own
+names at the places these get expanded in tasks.c */
+#ifndef __ASSEMBLER__
+#    include "trace.h"
+#endif
+
+#define traceTASK_SWITCHED_IN()                                               \
+    trace_event(TRACE_TASK_SWITCHED_IN, (uint16_t)pxCurrentTCB->uxTCBNumber)
+#define traceTASK_NOTIFY(...)                                                 \
+    trace_event(TRACE_NOTIFY, (uint16_t)pxTCB->uxTCBNumber)
+#define traceTASK_NOTIFY_GIVE_FROM_ISR(...)                                   \
+    trace_event(TRACE_NOTIFY_FROM_ISR, (uint16_t)pxTCB->uxTCBNumber)
+
 #include <assert.h>
 /* Define to trap errors during development. */
 #define configASSERT(x) assert(x)
@@ -0,0 +1,17 @@
+#include "boot.h"
+
+#include <hardware/timer.h>
+
+static uint32_t boot_times[(size_t)BootPhase::Count];
+
+void boot_mark(BootPhase phase)
+{
+    uint32_t* time = &boot_times[(size_t)phase];
+    if (*time == 0)
+    {
+        uint32_t now = time_us_32();
+        *time = now ? now : 1;
+    }
+}
+
+uint32_t boot_time(BootPhase phase) { return boot_times[(size_t)phase]; }
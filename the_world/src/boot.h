@@ -0,0 +1,32 @@
+#pragma once
+
+#include "common.h"
+
+// NOTE(patrik): Boot phase timestamps, time_us_32() at the first time each
+// phase was reached (the timer starts counting at reset). 0 means the phase
+// hasn't been reached yet. Every phase is marked from a single task so there
+// is no locking.
+//  ControlsReady    - Lines and controls configured, outputs driven off
+//  CanReady         - MCP2515 configured and its interrupt hooked up
+//  SchedulerStarted - Update thread running
+//  DeviceReady      - spec.init done, the device handles inputs from here
+//  FirstCanFrame    - First CAN frame handed to spec.on_can_message
+//  FirstOutput      - First control output change
+//  UsbReady         - TinyUSB initialized (USB thread)
+//  UsbMounted       - Host configured the device
+enum class BootPhase : uint8_t
+{
+    ControlsReady,
+    CanReady,
+    SchedulerStarted,
+    DeviceReady,
+    FirstCanFrame,
+    FirstOutput,
+    UsbReady,
+    UsbMounted,
+
+    Count,
+};
+
+void boot_mark(BootPhase phase);
+uint32_t boot_time(BootPhase phase);
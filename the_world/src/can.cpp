@@ -1,29 +1,130 @@
 #include "can.h"
 
+#include <atomic>
 #include <string.h>
+#include "boot.h"
 #include "device.h"
+#include "profile.h"
+#include "latency.h"
+#include "settings.h"
+#include "trace.h"
+#include "util/gpio_irq.h"
 
 #include <FreeRTOS.h>
 #include <task.h>
 
+#include <hardware/gpio.h>
+#include <hardware/timer.h>
+
 #include <mcp2515/mcp2515.h>
 
-MCP2515 can0(spi0, 5, 3, 4, 2);
+MCP2515 can0(spi0, CAN_CS_PIN, CAN_TX_PIN, CAN_RX_PIN, CAN_SCK_PIN);
+
+static CanStats stats;
+static uint64_t last_frame_time = 0;
+static std::atomic<bool> stats_reset_requested{false};
+
+// NOTE(patrik): 0 means no interrupt is waiting to be measured
+static std::atomic<uint32_t> irq_time{0};
+
+static void can_irq(uint32_t pin, uint32_t events)
+{
+    uint32_t now = time_us_32();
+    trace_event_at(now, TRACE_CAN_IRQ, 0);
+
+    if (irq_time.load(std::memory_order_relaxed) == 0)
+        irq_time.store(now ? now : 1, std::memory_order_relaxed);
+
+    device_wake_from_isr();
+}
+
+// NOTE(patrik): Has to match can_speed, anything else would quietly run at
+// 125 kbps
+static const uint32_t CAN_BITRATES[] = {50, 100, 125, 250, 500, 1000};
+
+static CAN_SPEED can_speed(uint32_t kbps)
+{
+    switch (kbps)
+    {
+        case 50: return CAN_50KBPS;
+        case 100: return CAN_100KBPS;
+        case 250: return CAN_250KBPS;
+        case 500: return CAN_500KBPS;
+        case 1000: return CAN_1000KBPS;
+        default: return CAN_125KBPS;
+    }
+}
 
 void can_init()
 {
+    settings_allow_u32(SETTING_CAN_BITRATE, CAN_BITRATES,
+                       sizeof(CAN_BITRATES) / sizeof(CAN_BITRATES[0]));
+    uint32_t kbps = settings_get_u32(SETTING_CAN_BITRATE, 125);
+
     can0.reset();
-    can0.setBitrate(CAN_125KBPS, MCP_8MHZ);
+    can0.setBitrate(can_speed(kbps), MCP_8MHZ);
     can0.setNormalMode();
+
+    gpio_init(CAN_INT_PIN);
+    gpio_set_dir(CAN_INT_PIN, GPIO_IN);
+    gpio_pull_up(CAN_INT_PIN);
+    gpio_irq_set_handler(CAN_INT_PIN, GPIO_IRQ_EDGE_FALL, can_irq);
+
+    boot_mark(BootPhase::CanReady);
 }
 
 void can_update()
 {
+    // NOTE(patrik): Drain both RX buffers, INT only goes high again once
+    // they are empty
+    // NOTE(patrik): No exchange() here or below, the M0+ has no atomic
+    // read-modify-write and the libatomic fallback takes a lock. Losing a
+    // sample to a race with the interrupt is fine.
+    if (stats_reset_requested.load())
+    {
+        stats_reset_requested.store(false);
+        stats = CanStats{};
+    }
+
     can_frame frame;
-    if (can0.readMessage(&frame) == MCP2515::ERROR_OK)
+    while (can0.readMessage(&frame) == MCP2515::ERROR_OK)
+    {
+        // NOTE(patrik): Only the first frame after an interrupt has a
+        // known arrival time
+        uint32_t start = irq_time.load(std::memory_order_relaxed);
+        if (start)
+        {
+            irq_time.store(0, std::memory_order_relaxed);
+
+            uint32_t latency = time_us_32() - start;
+            latency_record(LatencyPoint::CanRxDispatch, latency);
+
+            stats.num_measured++;
+            stats.last_latency = latency;
+            stats.total_latency += latency;
+            if (latency > stats.max_latency)
+                stats.max_latency = latency;
+        }
+
+        stats.num_frames++;
+        last_frame_time = time_us_64();
+        boot_mark(BootPhase::FirstCanFrame);
+
+        uint32_t handler_start = profile_begin();
         spec.on_can_message(frame.can_id, frame.data, frame.can_dlc);
+        profile_end(profile_handler(ProfileHandler::OnCanMessage),
+                    handler_start);
+        trace_span(TRACE_HANDLER_BEGIN, (uint16_t)ProfileHandler::OnCanMessage,
+                   handler_start);
+    }
 }
 
+CanStats can_stats() { return stats; }
+
+uint64_t can_last_frame_time() { return last_frame_time; }
+
+void can_stats_reset() { stats_reset_requested = true; }
+
 bool send_can_message(uint32_t can_id, uint8_t* data, size_t len)
 {
     // TODO(patrik): Check len
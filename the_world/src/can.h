@@ -2,6 +2,42 @@
 
 #include "common.h"
 
+// NOTE(patrik): MCP2515 on spi0
+const uint32_t CAN_SCK_PIN = 2;
+const uint32_t CAN_TX_PIN = 3;
+const uint32_t CAN_RX_PIN = 4;
+const uint32_t CAN_CS_PIN = 5;
+// NOTE(patrik): MCP2515 INT, pulled low while a frame is waiting
+const uint32_t CAN_INT_PIN = 6;
+
+// NOTE(patrik): Devices can't use these (see VALIDATE_DEVICE_SPEC)
+const uint32_t CAN_PINS = 1u << CAN_SCK_PIN | 1u << CAN_TX_PIN |
+                          1u << CAN_RX_PIN | 1u << CAN_CS_PIN |
+                          1u << CAN_INT_PIN;
+
+// NOTE(patrik): Latency from the MCP2515 INT edge to the first frame of
+// that interrupt being handed to the device (us)
+struct CanStats
+{
+    uint32_t num_frames;
+    uint32_t num_measured;
+    uint32_t last_latency;
+    uint32_t max_latency;
+    uint64_t total_latency;
+};
+
+// NOTE(patrik): Bitrate comes from SETTING_CAN_BITRATE (kbps), 125 when it
+// isn't set or isn't one the MCP2515 can do
 void can_init();
 void can_update();
+
+// NOTE(patrik): Update thread, when the last frame was read (us)
+uint64_t can_last_frame_time();
+
+// NOTE(patrik): Read from the COM task without a lock, a snapshot can mix
+// two frames worth of updates which is fine for diagnostics. The reset is
+// done by the update task on its next pass.
+CanStats can_stats();
+void can_stats_reset();
+
 bool send_can_message(uint32_t can_id, uint8_t* data, size_t len);
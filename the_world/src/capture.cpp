@@ -0,0 +1,252 @@
+#include "capture.h"
+
+#include "device.h"
+
+#include <hardware/clocks.h>
+#include <hardware/dma.h>
+#include <hardware/pio.h>
+
+const size_t CAPTURE_BUFFER_WORDS = CAPTURE_BUFFER_BYTES / sizeof(uint32_t);
+// NOTE(patrik): DMA ring size is a power of two in bytes, the buffer has to
+// be aligned to it
+const uint32_t CAPTURE_RING_BITS = 14;
+static_assert(1u << CAPTURE_RING_BITS == CAPTURE_BUFFER_BYTES,
+              "Ring bits don't match the buffer size");
+
+// NOTE(patrik): Longest delay an instruction can have without side-set
+const uint32_t MAX_DELAY = 31;
+
+static uint32_t capture_buffer[CAPTURE_BUFFER_WORDS]
+    __attribute__((aligned(CAPTURE_BUFFER_BYTES)));
+
+static PIO pio = pio0;
+static int sm = -1;
+static int dma_channel = -1;
+
+static uint16_t program_instructions[3];
+static pio_program_t program = {
+    .instructions = program_instructions,
+    .length = 0,
+    .origin = -1,
+};
+static uint32_t program_offset = 0;
+
+static bool active = false;
+static bool ring = false;
+static uint32_t transfer_count = 0;
+static uint32_t words_done = 0;
+
+static uint32_t base_pin = 0;
+static uint32_t sample_width = 0;
+static uint32_t sample_rate = 0;
+
+static uint32_t current_words()
+{
+    return transfer_count - dma_channel_hw_addr(dma_channel)->transfer_count;
+}
+
+static void release()
+{
+    if (sm >= 0)
+    {
+        pio_sm_set_enabled(pio, sm, false);
+        pio_remove_program(pio, &program, program_offset);
+        pio_sm_unclaim(pio, sm);
+        sm = -1;
+    }
+
+    if (dma_channel >= 0)
+    {
+        dma_channel_abort(dma_channel);
+        dma_channel_unclaim(dma_channel);
+        dma_channel = -1;
+    }
+
+    active = false;
+}
+
+uint32_t capture_start(uint32_t rate, CaptureTrigger trigger,
+                       uint8_t trigger_line)
+{
+    capture_stop();
+    words_done = 0;
+    sample_rate = 0;
+
+    if (spec.num_lines == 0 || rate == 0 ||
+        (trigger != CaptureTrigger::None && trigger_line >= spec.num_lines))
+        return 0;
+
+    uint32_t min_pin = spec.lines[0];
+    uint32_t max_pin = spec.lines[0];
+    for (size_t i = 1; i < spec.num_lines; i++)
+    {
+        if (spec.lines[i] < min_pin)
+            min_pin = spec.lines[i];
+        if (spec.lines[i] > max_pin)
+            max_pin = spec.lines[i];
+    }
+
+    // NOTE(patrik): Samples have to divide the 32 bit autopush evenly
+    uint32_t span = max_pin - min_pin + 1;
+    base_pin = min_pin;
+    sample_width = span <= 8 ? 8 : span <= 16 ? 16 : 32;
+
+    // NOTE(patrik): One instruction per sample, slow rates stretch it with
+    // a delay when the clock divider alone can't get there
+    uint32_t sys_clock = clock_get_hz(clk_sys);
+    if (rate > sys_clock)
+        rate = sys_clock;
+
+    uint32_t delay = 0;
+    if (sys_clock / rate > 65535)
+        delay = MAX_DELAY;
+
+    float divider = (float)sys_clock / ((float)rate * (float)(delay + 1));
+    if (divider > 65535.0f)
+        divider = 65535.0f;
+    if (divider < 1.0f)
+        divider = 1.0f;
+
+    sample_rate = (uint32_t)((float)sys_clock / (divider * (float)(delay + 1)));
+
+    size_t length = 0;
+    uint32_t trigger_pin =
+        trigger != CaptureTrigger::None ? spec.lines[trigger_line] : 0;
+    switch (trigger)
+    {
+        case CaptureTrigger::None: break;
+        case CaptureTrigger::Low:
+            program_instructions[length++] =
+                pio_encode_wait_gpio(false, trigger_pin);
+            break;
+        case CaptureTrigger::High:
+            program_instructions[length++] =
+                pio_encode_wait_gpio(true, trigger_pin);
+            break;
+        case CaptureTrigger::Falling:
+            program_instructions[length++] =
+                pio_encode_wait_gpio(true, trigger_pin);
+            program_instructions[length++] =
+                pio_encode_wait_gpio(false, trigger_pin);
+            break;
+        case CaptureTrigger::Rising:
+            program_instructions[length++] =
+                pio_encode_wait_gpio(false, trigger_pin);
+            program_instructions[length++] =
+                pio_encode_wait_gpio(true, trigger_pin);
+            break;
+    }
+
+    uint32_t sample_instruction = length;
+    program_instructions[length++] =
+        pio_encode_in(pio_pins, sample_width) | pio_encode_delay(delay);
+    program.length = (uint8_t)length;
+
+    if (!pio_can_add_program(pio, &program))
+        return 0;
+
+    sm = pio_claim_unused_sm(pio, false);
+    dma_channel = dma_claim_unused_channel(false);
+    if (sm < 0 || dma_channel < 0)
+    {
+        release();
+        return 0;
+    }
+
+    program_offset = pio_add_program(pio, &program);
+
+    pio_sm_config config = pio_get_default_sm_config();
+    sm_config_set_wrap(&config, program_offset + sample_instruction,
+                       program_offset + sample_instruction);
+    sm_config_set_in_pins(&config, base_pin);
+    // NOTE(patrik): Shift right, the oldest sample ends up in the low bits
+    sm_config_set_in_shift(&config, true, true, 32);
+    sm_config_set_fifo_join(&config, PIO_FIFO_JOIN_RX);
+    sm_config_set_clkdiv(&config, divider);
+    pio_sm_init(pio, sm, program_offset, &config);
+
+    ring = trigger == CaptureTrigger::None;
+    transfer_count = ring ? UINT32_MAX : CAPTURE_BUFFER_WORDS;
+
+    dma_channel_config dma_config =
+        dma_channel_get_default_config(dma_channel);
+    channel_config_set_transfer_data_size(&dma_config, DMA_SIZE_32);
+    channel_config_set_read_increment(&dma_config, false);
+    channel_config_set_write_increment(&dma_config, true);
+    channel_config_set_dreq(&dma_config, pio_get_dreq(pio, sm, false));
+    if (ring)
+        channel_config_set_ring(&dma_config, true, CAPTURE_RING_BITS);
+
+    dma_channel_configure(dma_channel, &dma_config, capture_buffer,
+                          &pio->rxf[sm], transfer_count, true);
+
+    active = true;
+    pio_sm_set_enabled(pio, sm, true);
+
+    return sample_rate;
+}
+
+void capture_stop()
+{
+    if (!active)
+        return;
+
+    pio_sm_set_enabled(pio, sm, false);
+    words_done = current_words();
+    release();
+}
+
+CaptureState capture_state()
+{
+    if (!active)
+        return words_done > 0 ? CaptureState::Done : CaptureState::Idle;
+
+    uint32_t words = current_words();
+    if (words == 0)
+        return CaptureState::Armed;
+
+    if (!ring && words >= transfer_count)
+    {
+        capture_stop();
+        return CaptureState::Done;
+    }
+
+    return CaptureState::Running;
+}
+
+uint32_t capture_rate() { return sample_rate; }
+
+uint32_t capture_count()
+{
+    if (active)
+        return 0;
+
+    uint32_t words =
+        words_done < CAPTURE_BUFFER_WORDS ? words_done : CAPTURE_BUFFER_WORDS;
+    return words * (32 / sample_width);
+}
+
+uint16_t capture_get(uint32_t index)
+{
+    uint32_t samples_per_word = 32 / sample_width;
+
+    // NOTE(patrik): Once the ring has wrapped the oldest word is the one
+    // after the last written
+    uint32_t first_word = 0;
+    if (words_done > CAPTURE_BUFFER_WORDS)
+        first_word = words_done % CAPTURE_BUFFER_WORDS;
+
+    uint32_t word = (first_word + index / samples_per_word) %
+                    CAPTURE_BUFFER_WORDS;
+    uint32_t shift = (index % samples_per_word) * sample_width;
+    uint32_t pins = capture_buffer[word] >> shift;
+
+    uint16_t levels = 0;
+    for (size_t i = 0; i < spec.num_lines; i++)
+    {
+        if ((pins >> (spec.lines[i] - base_pin)) & 1)
+            levels |= 1 << i;
+    }
+
+    return levels;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "common.h"
+
+// NOTE(patrik): Logic analyzer for the input lines. A PIO state machine
+// samples every pin between the lowest and highest entry in spec.lines and
+// DMA moves the samples into a RAM buffer, the CPU isn't involved until the
+// capture is read out.
+//
+// Without a trigger the buffer is a ring that keeps the newest samples until
+// the capture is stopped. With a trigger the state machine waits on the
+// trigger line (in PIO) and the capture fills the buffer once.
+//
+// Only used from the COM thread.
+const size_t CAPTURE_BUFFER_BYTES = 16 * 1024;
+
+enum class CaptureTrigger : uint8_t
+{
+    None,
+    Low,
+    High,
+    Falling,
+    Rising,
+};
+
+enum class CaptureState : uint8_t
+{
+    Idle,
+    // NOTE(patrik): Waiting on the trigger
+    Armed,
+    Running,
+    // NOTE(patrik): Stopped or the buffer is full, ready to be read
+    Done,
+};
+
+// NOTE(patrik): rate in samples per second, trigger_line is an index into
+// spec.lines. Returns the rate the PIO clock divider actually got, 0 if the
+// capture couldn't start.
+uint32_t capture_start(uint32_t rate, CaptureTrigger trigger,
+                       uint8_t trigger_line);
+void capture_stop();
+
+CaptureState capture_state();
+uint32_t capture_rate();
+
+// NOTE(patrik): Only once the capture is Done. Levels of each line (bit per
+// entry in spec.lines, 1 is high) for sample index, 0 is the oldest.
+uint32_t capture_count();
+uint16_t capture_get(uint32_t index);
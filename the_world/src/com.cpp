@@ -1,23 +1,134 @@
 #include "com.h"
 
+#include <string.h>
+
 #include "device.h"
+#include "command.h"
+#include "can.h"
+#include "boot.h"
+#include "capture.h"
+#include "power.h"
+#include "memory.h"
+#include "profile.h"
+#include "latency.h"
+#include "settings.h"
+#include "status.h"
+#include "supervisor.h"
+#include "trace.h"
 
 #include <class/cdc/cdc_device.h>
+#if CFG_TUD_VENDOR
+#    include <class/vendor/vendor_device.h>
+#endif
 
 #include <FreeRTOS.h>
 #include <task.h>
 
+#include <hardware/timer.h>
+
 static uint8_t data_buffer[256];
 static size_t current_data_offset = 0;
+static uint8_t response_pid = 0;
+
+// NOTE(patrik): The same packets can arrive on the CDC port or on the vendor
+// bulk interface, the response goes back on the one the request came from
+enum class Transport
+{
+    Cdc,
+    Vendor,
+};
+
+static Transport transport = Transport::Cdc;
+
+static TaskHandle_t com_thread_handle;
+
+uint32_t transport_available(Transport t)
+{
+    switch (t)
+    {
+        case Transport::Cdc: return tud_cdc_n_available(PORT_CMD);
+#if CFG_TUD_VENDOR
+        case Transport::Vendor: return tud_vendor_n_available(0);
+#endif
+        default: return 0;
+    }
+}
+
+uint32_t transport_read(uint8_t* buffer, uint32_t len)
+{
+    switch (transport)
+    {
+        case Transport::Cdc: return tud_cdc_n_read(PORT_CMD, buffer, len);
+#if CFG_TUD_VENDOR
+        case Transport::Vendor: return tud_vendor_n_read(0, buffer, len);
+#endif
+        default: return 0;
+    }
+}
+
+// NOTE(patrik): Only queues what fits in the TX FIFO, returns how much that
+// was
+uint32_t transport_write(uint8_t* data, uint32_t len)
+{
+    switch (transport)
+    {
+        case Transport::Cdc: return tud_cdc_n_write(PORT_CMD, data, len);
+#if CFG_TUD_VENDOR
+        case Transport::Vendor: return tud_vendor_n_write(0, data, len);
+#endif
+        default: return len;
+    }
+}
+
+uint32_t transport_write_available()
+{
+    switch (transport)
+    {
+        case Transport::Cdc: return tud_cdc_n_write_available(PORT_CMD);
+#if CFG_TUD_VENDOR
+        case Transport::Vendor: return tud_vendor_n_write_available(0);
+#endif
+        default: return 0;
+    }
+}
+
+bool transport_connected()
+{
+    switch (transport)
+    {
+        case Transport::Cdc: return tud_cdc_n_connected(PORT_CMD);
+#if CFG_TUD_VENDOR
+        case Transport::Vendor: return tud_vendor_n_mounted(0);
+#endif
+        default: return false;
+    }
+}
+
+void transport_flush()
+{
+    switch (transport)
+    {
+        case Transport::Cdc: tud_cdc_n_write_flush(PORT_CMD); break;
+#if CFG_TUD_VENDOR
+        case Transport::Vendor: tud_vendor_n_write_flush(0); break;
+#endif
+        default: break;
+    }
+}
 
 void read(uint8_t* buffer, uint32_t len)
 {
-    for (uint32_t i = 0; i < len; i++)
+    uint32_t offset = 0;
+    while (offset < len)
     {
-        while (tud_cdc_n_available(PORT_CMD) < 1)
-            ;
+        // NOTE(patrik): Waiting on the host isn't a stall, keep checking in
+        while (transport_available(transport) < 1)
+        {
+            supervisor_checkin(SupervisedTask::Com);
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(SUPERVISOR_CHECKIN_MS));
+        }
 
-        tud_cdc_n_read(PORT_CMD, buffer + i, 1);
+        offset += transport_read(buffer + offset, len - offset);
     }
 }
 
@@ -65,10 +176,25 @@ uint16_t read_u16()
 
 void write(uint8_t* data, uint32_t len)
 {
-    // TODO(patrik): Use this to check if the write buffer is full and
-    // then flush it
-    // uint32_t avail = tud_cdc_n_write_available(PORT_CMD);
-    tud_cdc_n_write(PORT_CMD, data, len);
+    uint32_t offset = 0;
+    while (offset < len)
+    {
+        // NOTE(patrik): The TX FIFO is smaller than most responses (64 bytes
+        // for CDC). When it's full push out what's queued and wait for the
+        // USB task to send it, a host that went away drops the rest.
+        if (transport_write_available() == 0)
+        {
+            if (!transport_connected())
+                return;
+
+            transport_flush();
+            supervisor_checkin(SupervisedTask::Com);
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(1));
+            continue;
+        }
+
+        offset += transport_write(data + offset, len - offset);
+    }
 }
 
 void write_u8(uint8_t value) { write(&value, 1); }
@@ -87,6 +213,7 @@ Packet parse_packet()
 
     read(data_buffer, (uint32_t)data_len);
     current_data_offset = 0;
+    response_pid = pid;
 
     uint16_t checksum = read_u16();
 
@@ -95,20 +222,21 @@ Packet parse_packet()
     packet.typ = (PacketType)typ;
     packet.data_len = data_len;
     packet.checksum = checksum;
+    packet.receive_time = 0;
 
     return packet;
 }
 
-void write_packet_header(PacketType type)
+void write_packet_header(PacketType type, uint8_t pid)
 {
     write_u8(PACKET_START);
-    write_u8(0);
+    write_u8(pid);
     write_u8((uint8_t)type);
 }
 
 void send_packet(PacketType type, uint8_t* data, uint8_t len)
 {
-    write_packet_header(type);
+    write_packet_header(type, 0);
 
     write_u8(len);
 
@@ -119,13 +247,15 @@ void send_packet(PacketType type, uint8_t* data, uint8_t len)
     // Checksum
     write_u16(0);
 
-    tud_cdc_n_write_flush(PORT_CMD);
+    transport_flush();
 }
 
 void send_packet_response(ResponseErrorCode error_code, uint8_t* data,
                           size_t len)
 {
-    write_packet_header(PacketType::Response);
+    // NOTE(patrik): Responses carry the id of the request so the host can
+    // tell a late answer from the one it is waiting for
+    write_packet_header(PacketType::Response, response_pid);
 
     // NOTE(patrik): Length of data + error code
     write_u8(len + 1);
@@ -138,11 +268,53 @@ void send_packet_response(ResponseErrorCode error_code, uint8_t* data,
     // Checksum
     write_u16(0);
 
-    tud_cdc_n_write_flush(PORT_CMD);
+    transport_flush();
 }
 
 void send_empty_packet(PacketType type) { send_packet(type, nullptr, 0); }
 
+// NOTE(patrik): Response data for the bigger packets is built up with the
+// push_* functions and then sent with send_response_data()
+static uint8_t response_data[254];
+static size_t response_data_len = 0;
+
+void begin_response_data() { response_data_len = 0; }
+
+void push_u8(uint8_t value)
+{
+    if (response_data_len < sizeof(response_data))
+        response_data[response_data_len++] = value;
+}
+
+void push_u16(uint16_t value)
+{
+    push_u8(value & 0xff);
+    push_u8((value >> 8) & 0xff);
+}
+
+void push_u32(uint32_t value)
+{
+    push_u16(value & 0xffff);
+    push_u16((value >> 16) & 0xffff);
+}
+
+void push_u64(uint64_t value)
+{
+    push_u32(value & 0xffffffff);
+    push_u32((value >> 32) & 0xffffffff);
+}
+
+size_t response_data_left()
+{
+    return sizeof(response_data) - response_data_len;
+}
+
+void send_response_data()
+{
+    send_packet_response(ResponseErrorCode::Success, response_data,
+                         response_data_len);
+}
+
 static bool send_updates = false;
 
 static uint8_t temp[256];
@@ -161,7 +333,7 @@ void identify(DeviceContext* device)
     buffer[1] = (spec.version >> 8) & 0xff;
 
     // Num Commands
-    buffer[2] = (uint8_t)device->num_cmds;
+    buffer[2] = (uint8_t)spec.num_cmds;
 
     // Name
     // TODO(patrik): Check for string length is not over 32
@@ -172,10 +344,10 @@ void identify(DeviceContext* device)
 
 void status()
 {
+    // NOTE(patrik): The update thread publishes the status, this is only a
+    // copy of the last one
     uint8_t buffer[STATUS_BUFFER_SIZE];
-    memset(buffer, 0, sizeof(buffer));
-
-    spec.get_status(buffer);
+    status_read(buffer);
 
     send_packet_response(ResponseErrorCode::Success, buffer, sizeof(buffer));
 }
@@ -191,7 +363,7 @@ void command(Packet* packet, DeviceContext* device)
 
     uint8_t cmd_index = read_u8_from_data();
 
-    if (cmd_index >= device->num_cmds)
+    if (cmd_index >= spec.num_cmds)
     {
         send_packet_response(ResponseErrorCode::InvalidFunction, nullptr, 0);
         return;
@@ -201,22 +373,724 @@ void command(Packet* packet, DeviceContext* device)
     if (packet->data_len > 0)
         num_params = packet->data_len - 1;
 
-    CmdFunction cmd = spec.funcs[cmd_index];
-    ResponseErrorCode error_code =
-        cmd(data_buffer + current_data_offset, num_params);
-    send_packet_response(error_code, nullptr, 0);
+    // NOTE(patrik): The command runs on the update task, we just wait for
+    // the result here
+    if (!command_submit(cmd_index, data_buffer + current_data_offset,
+                        num_params))
+    {
+        // TODO(patrik): Change error code
+        send_packet_response(ResponseErrorCode::InvalidDevice, nullptr, 0);
+        return;
+    }
+
+    CommandResult result;
+    command_wait_result(&result);
+    send_packet_response(result.error_code, nullptr, 0);
+
+    latency_record(LatencyPoint::CommandResponse,
+                   time_us_32() - packet->receive_time);
 }
 
 void ping() { send_packet_response(ResponseErrorCode::Success, nullptr, 0); }
 
+void power()
+{
+    // NOTE(patrik): Bytes
+    //  8 bytes - Uptime (us)
+    //  8 bytes - Time spent sleeping (us)
+    //  4 bytes - Number of wakeups from sleep
+    //  1 byte - Number of cores the sleep time is summed over
+    PowerStats stats = power_stats();
+
+    begin_response_data();
+    push_u64(stats.uptime);
+    push_u64(stats.sleep_time);
+    push_u32(stats.num_wakeups);
+    push_u8((uint8_t)stats.num_cores);
+    send_response_data();
+}
+
+void can_latency(Packet* packet)
+{
+    // NOTE(patrik): Request
+    //  1 byte (optional) - 1 to reset the stats after reading them
+    //
+    // Bytes
+    //  4 bytes - Frames received
+    //  4 bytes - Frames with a measured latency
+    //  4 bytes - Last latency (us)
+    //  4 bytes - Max latency (us)
+    //  8 bytes - Sum of all measured latencies (us)
+    bool reset = packet->data_len > 0 && read_u8_from_data() == 1;
+
+    CanStats stats = can_stats();
+    if (reset)
+        can_stats_reset();
+
+    begin_response_data();
+    push_u32(stats.num_frames);
+    push_u32(stats.num_measured);
+    push_u32(stats.last_latency);
+    push_u32(stats.max_latency);
+    push_u64(stats.total_latency);
+    send_response_data();
+}
+
+// NOTE(patrik): More than we create (3 threads, idle per core, timer) so
+// uxTaskGetSystemState doesn't give up
+const size_t MAX_TASK_STATS = 12;
+static TaskStatus_t task_status[MAX_TASK_STATS];
+
+void task_stats()
+{
+    // NOTE(patrik): Bytes
+    //  4 bytes - Free FreeRTOS heap
+    //  4 bytes - Lowest free FreeRTOS heap since boot
+    //  4 bytes - Free RAM (malloc break to the stack)
+    //  1 byte - Num tasks
+    //  Per task:
+    //    1 byte - Name length
+    //    N bytes - Name
+    //    4 bytes - Stack high water mark (words never used)
+    MemoryStats memory = memory_stats();
+
+    UBaseType_t num_tasks =
+        uxTaskGetSystemState(task_status, MAX_TASK_STATS, nullptr);
+
+    begin_response_data();
+    push_u32(memory.free_heap);
+    push_u32(memory.min_free_heap);
+    push_u32(memory.free_ram);
+    push_u8((uint8_t)num_tasks);
+
+    for (UBaseType_t i = 0; i < num_tasks; i++)
+    {
+        const char* name = task_status[i].pcTaskName;
+        size_t len = strlen(name);
+
+        push_u8((uint8_t)len);
+        for (size_t c = 0; c < len; c++)
+            push_u8((uint8_t)name[c]);
+        push_u32((uint32_t)task_status[i].usStackHighWaterMark);
+    }
+
+    send_response_data();
+}
+
+enum class ProfileKind : uint8_t
+{
+    Tasks,
+    Handlers,
+    Commands,
+};
+
+void push_profile_stat(ProfileStat* stat)
+{
+    push_u32(stat->count);
+    push_u32(stat->min);
+    push_u32(stat->max);
+    push_u64(stat->total);
+}
+
+void profile(Packet* packet, DeviceContext* device)
+{
+    // NOTE(patrik): Request
+    //  1 byte - Kind (0 = tasks, 1 = handlers, 2 = commands)
+    //  1 byte - Index of the first entry
+    //
+    // Bytes
+    //  4 bytes - Total run time (us, tasks only, wraps)
+    //  1 byte - Total number of entries
+    //  1 byte - Number of entries in this response
+    //  Per task:
+    //    1 byte - Name length
+    //    N bytes - Name
+    //    4 bytes - Run time (us, wraps)
+    //  Per handler / command:
+    //    4 bytes - Count
+    //    4 bytes - Min (us)
+    //    4 bytes - Max (us)
+    //    8 bytes - Total (us)
+    //
+    // Entries that don't fit are left for the next request. The task list
+    // can reorder between requests, but all of our tasks fit in one.
+    if (packet->data_len < 2)
+    {
+        send_packet_response(ResponseErrorCode::InsufficientFunctionParameters,
+                             nullptr, 0);
+        return;
+    }
+
+    ProfileKind kind = (ProfileKind)read_u8_from_data();
+    size_t first = read_u8_from_data();
+
+    const size_t HEADER_SIZE = 4 + 1 + 1;
+    const size_t STAT_SIZE = 4 + 4 + 4 + 8;
+
+    uint32_t total_run_time = 0;
+    size_t num_entries = 0;
+
+    switch (kind)
+    {
+        case ProfileKind::Tasks:
+            num_entries = uxTaskGetSystemState(task_status, MAX_TASK_STATS,
+                                               &total_run_time);
+            break;
+        case ProfileKind::Handlers:
+            num_entries = (size_t)ProfileHandler::Count;
+            break;
+        case ProfileKind::Commands: num_entries = spec.num_cmds; break;
+
+        default:
+            send_packet_response(ResponseErrorCode::InvalidFunction, nullptr,
+                                 0);
+            return;
+    }
+
+    begin_response_data();
+    push_u32(total_run_time);
+    push_u8((uint8_t)num_entries);
+    push_u8(0);
+
+    uint8_t count = 0;
+    for (size_t i = first; i < num_entries; i++)
+    {
+        if (kind == ProfileKind::Tasks)
+        {
+            const char* name = task_status[i].pcTaskName;
+            size_t len = strlen(name);
+            if (response_data_left() < 1 + len + 4)
+                break;
+
+            push_u8((uint8_t)len);
+            for (size_t c = 0; c < len; c++)
+                push_u8((uint8_t)name[c]);
+            push_u32((uint32_t)task_status[i].ulRunTimeCounter);
+        }
+        else
+        {
+            if (response_data_left() < STAT_SIZE)
+                break;
+
+            if (kind == ProfileKind::Handlers)
+                push_profile_stat(profile_handler((ProfileHandler)i));
+            else
+                push_profile_stat(profile_command(i));
+        }
+
+        count++;
+    }
+
+    response_data[HEADER_SIZE - 1] = count;
+    send_response_data();
+}
+
+// NOTE(patrik): Snapshot of the histogram being transferred, pages after
+// the first one are served from here
+static uint32_t histogram_snapshot[Histogram::NUM_BUCKETS];
+
+void latency(Packet* packet)
+{
+    // NOTE(patrik): Request
+    //  1 byte - Histogram (LatencyPoint)
+    //  1 byte - First bucket, 0 takes a new snapshot
+    //  1 byte (optional) - 1 to reset the histogram with the new snapshot
+    //
+    // Bytes
+    //  1 byte - Sub bucket bits
+    //  1 byte - Number of buckets
+    //  1 byte - Next bucket to ask for (number of buckets when done)
+    //  1 byte - Number of entries
+    //  Per non-empty bucket:
+    //    1 byte - Bucket index
+    //    4 bytes - Count
+    if (packet->data_len < 2)
+    {
+        send_packet_response(ResponseErrorCode::InsufficientFunctionParameters,
+                             nullptr, 0);
+        return;
+    }
+
+    uint8_t point = read_u8_from_data();
+    size_t first = read_u8_from_data();
+    bool reset = packet->data_len > 2 && read_u8_from_data() == 1;
+
+    if (point >= (uint8_t)LatencyPoint::Count)
+    {
+        send_packet_response(ResponseErrorCode::InvalidFunction, nullptr, 0);
+        return;
+    }
+
+    if (first == 0)
+        latency_histogram((LatencyPoint)point)->take(histogram_snapshot, reset);
+
+    const size_t HEADER_SIZE = 4;
+    const size_t ENTRY_SIZE = 1 + 4;
+
+    begin_response_data();
+    push_u8(Histogram::SUB_BUCKET_BITS);
+    push_u8(Histogram::NUM_BUCKETS);
+    push_u8(0);
+    push_u8(0);
+
+    size_t next = first;
+    uint8_t count = 0;
+    for (; next < Histogram::NUM_BUCKETS; next++)
+    {
+        if (histogram_snapshot[next] == 0)
+            continue;
+
+        if (response_data_left() < ENTRY_SIZE)
+            break;
+
+        push_u8((uint8_t)next);
+        push_u32(histogram_snapshot[next]);
+        count++;
+    }
+
+    response_data[HEADER_SIZE - 2] = (uint8_t)next;
+    response_data[HEADER_SIZE - 1] = count;
+    send_response_data();
+}
+
+enum class TraceCommand : uint8_t
+{
+    Freeze,
+    Read,
+    Tasks,
+    Resume,
+};
+
+void push_trace_events(uint32_t core, uint32_t first)
+{
+    const size_t EVENT_SIZE = 4 + 1 + 2;
+
+    if (core >= TRACE_NUM_CORES)
+        core = 0;
+
+    uint32_t count = trace_count(core);
+    uint32_t num_events = 0;
+    if (first < count)
+    {
+        num_events = count - first;
+        size_t max_events = (response_data_left() - 1) / EVENT_SIZE;
+        if (num_events > max_events)
+            num_events = max_events;
+    }
+
+    push_u8((uint8_t)num_events);
+    for (uint32_t i = 0; i < num_events; i++)
+    {
+        TraceEvent event = trace_get(core, first + i);
+        push_u32(event.time);
+        push_u8(event.type);
+        push_u16(event.arg);
+    }
+}
+
+void push_trace_tasks()
+{
+    UBaseType_t num_tasks =
+        uxTaskGetSystemState(task_status, MAX_TASK_STATS, nullptr);
+
+    push_u8((uint8_t)num_tasks);
+    for (UBaseType_t i = 0; i < num_tasks; i++)
+    {
+        const char* name = task_status[i].pcTaskName;
+        size_t len = strlen(name);
+
+        push_u16((uint16_t)task_status[i].xTaskNumber);
+        push_u8((uint8_t)len);
+        for (size_t c = 0; c < len; c++)
+            push_u8((uint8_t)name[c]);
+    }
+}
+
+void trace(Packet* packet)
+{
+    // NOTE(patrik): Request
+    //  1 byte - Command
+    //  Freeze: stops recording
+    //    1 byte - Number of cores
+    //    Per core: 2 bytes - Number of events
+    //  Read: 1 byte core, 2 bytes first event (0 is the oldest)
+    //    1 byte - Number of events
+    //    Per event: 4 bytes time (us, wraps), 1 byte type, 2 bytes arg
+    //  Tasks: names for the TCB numbers in the events
+    //    1 byte - Number of tasks
+    //    Per task: 2 bytes TCB number, 1 byte name length, N bytes name
+    //  Resume: clears the buffer and starts recording again
+    if (packet->data_len < 1)
+    {
+        send_packet_response(ResponseErrorCode::InsufficientFunctionParameters,
+                             nullptr, 0);
+        return;
+    }
+
+    TraceCommand cmd = (TraceCommand)read_u8_from_data();
+    if (cmd == TraceCommand::Read && packet->data_len < 4)
+    {
+        send_packet_response(ResponseErrorCode::InsufficientFunctionParameters,
+                             nullptr, 0);
+        return;
+    }
+
+    uint32_t core = 0;
+    uint32_t first = 0;
+    if (cmd == TraceCommand::Read)
+    {
+        core = read_u8_from_data();
+        first = read_u16_from_data();
+    }
+
+    begin_response_data();
+
+    switch (cmd)
+    {
+        case TraceCommand::Freeze:
+            trace_freeze(true);
+
+            push_u8(TRACE_NUM_CORES);
+            for (uint32_t core = 0; core < TRACE_NUM_CORES; core++)
+                push_u16((uint16_t)trace_count(core));
+            break;
+
+        case TraceCommand::Read: push_trace_events(core, first); break;
+
+        case TraceCommand::Tasks: push_trace_tasks(); break;
+
+        case TraceCommand::Resume:
+            trace_clear();
+            trace_freeze(false);
+            break;
+
+        default:
+            send_packet_response(ResponseErrorCode::InvalidFunction, nullptr,
+                                 0);
+            return;
+    }
+
+    send_response_data();
+}
+
+void schedule(Packet* packet)
+{
+    // NOTE(patrik): Request
+    //  1 byte (optional) - 1 to reset the stats after reading them
+    //
+    // Bytes
+    //  4 bytes - Update period (us), 0 if the device isn't fixed rate
+    //  4 bytes - Updates run
+    //  4 bytes - Overruns (periods skipped)
+    //  4 bytes - Last lateness (us)
+    //  4 bytes - Max lateness (us)
+    //  4 bytes - Input edges dropped (queue full)
+    bool reset = packet->data_len > 0 && read_u8_from_data() == 1;
+
+    UpdateStats stats = update_stats();
+    if (reset)
+        update_stats_reset();
+
+    begin_response_data();
+    push_u32(spec.update_period);
+    push_u32(stats.num_updates);
+    push_u32(stats.num_overruns);
+    push_u32(stats.last_lateness);
+    push_u32(stats.max_lateness);
+    push_u32(stats.num_dropped_edges);
+    send_response_data();
+}
+
+void boot()
+{
+    // NOTE(patrik): Bytes
+    //  1 byte  - Number of phases
+    //  4 bytes - Time of each phase (us since reset, 0 if not reached yet)
+    begin_response_data();
+    push_u8((uint8_t)BootPhase::Count);
+    for (size_t i = 0; i < (size_t)BootPhase::Count; i++)
+        push_u32(boot_time((BootPhase)i));
+    send_response_data();
+}
+
+void supervisor()
+{
+    // NOTE(patrik): Bytes
+    //  1 byte  - 1 if this boot was a warm restart after a watchdog reset
+    //  2 bytes - Warm restarts since the last cold boot
+    //  1 byte  - Task that stalled before the last reset (0xff for none)
+    //  1 byte  - Number of tasks
+    //  4 bytes - Time since each task last checked in (us, 0 if the task
+    //            isn't registered)
+    SupervisorStats stats = supervisor_stats();
+
+    begin_response_data();
+    push_u8(stats.warm_restart ? 1 : 0);
+    push_u16(stats.num_warm_restarts);
+    push_u8(stats.last_stalled_task);
+    push_u8((uint8_t)SupervisedTask::Count);
+    for (size_t i = 0; i < (size_t)SupervisedTask::Count; i++)
+        push_u32(supervisor_checkin_age((SupervisedTask)i));
+    send_response_data();
+}
+
+enum class CaptureCommand : uint8_t
+{
+    Start,
+    Status,
+    Stop,
+    Read,
+};
+
+struct CaptureRun
+{
+    uint16_t levels;
+    uint16_t length;
+};
+
+const size_t MAX_CAPTURE_RUNS = 64;
+static CaptureRun capture_runs[MAX_CAPTURE_RUNS];
+
+void push_capture_runs(uint32_t first)
+{
+    const size_t RUN_SIZE = 2 + 2;
+
+    uint32_t count = capture_count();
+    size_t max_runs = (response_data_left() - 4 - 1) / RUN_SIZE;
+    if (max_runs > MAX_CAPTURE_RUNS)
+        max_runs = MAX_CAPTURE_RUNS;
+
+    // NOTE(patrik): Runs are cut at the end of a packet, the host joins
+    // them back up
+    uint32_t index = first;
+    size_t num_runs = 0;
+    while (index < count && num_runs < max_runs)
+    {
+        uint16_t levels = capture_get(index);
+        uint32_t length = 1;
+        while (index + length < count && length < UINT16_MAX &&
+               capture_get(index + length) == levels)
+        {
+            length++;
+        }
+
+        capture_runs[num_runs].levels = levels;
+        capture_runs[num_runs].length = (uint16_t)length;
+        num_runs++;
+
+        index += length;
+    }
+
+    push_u32(first);
+    push_u8((uint8_t)num_runs);
+    for (size_t i = 0; i < num_runs; i++)
+    {
+        push_u16(capture_runs[i].levels);
+        push_u16(capture_runs[i].length);
+    }
+}
+
+void capture(Packet* packet)
+{
+    // NOTE(patrik): Request
+    //  1 byte - Command
+    //  Start: 4 bytes rate (samples/s), 1 byte trigger (CaptureTrigger),
+    //         1 byte trigger line
+    //    4 bytes - Actual rate
+    //  Status:
+    //    1 byte  - CaptureState
+    //    1 byte  - Number of lines
+    //    4 bytes - Rate (samples/s)
+    //    4 bytes - Samples ready to read
+    //  Stop: ends a capture, a ring capture keeps its newest samples
+    //  Read: 4 bytes first sample
+    //    4 bytes - First sample
+    //    1 byte  - Number of runs
+    //    Per run: 2 bytes levels (bit per line), 2 bytes length (samples)
+    if (packet->data_len < 1)
+    {
+        send_packet_response(ResponseErrorCode::InsufficientFunctionParameters,
+                             nullptr, 0);
+        return;
+    }
+
+    CaptureCommand cmd = (CaptureCommand)read_u8_from_data();
+    if ((cmd == CaptureCommand::Start && packet->data_len < 7) ||
+        (cmd == CaptureCommand::Read && packet->data_len < 5))
+    {
+        send_packet_response(ResponseErrorCode::InsufficientFunctionParameters,
+                             nullptr, 0);
+        return;
+    }
+
+    uint32_t rate = 0;
+    CaptureTrigger trigger = CaptureTrigger::None;
+    uint8_t trigger_line = 0;
+    uint32_t first = 0;
+    if (cmd == CaptureCommand::Start)
+    {
+        rate = read_u32_from_data();
+        trigger = (CaptureTrigger)read_u8_from_data();
+        trigger_line = read_u8_from_data();
+    }
+    else if (cmd == CaptureCommand::Read)
+    {
+        first = read_u32_from_data();
+    }
+
+    begin_response_data();
+
+    switch (cmd)
+    {
+        case CaptureCommand::Start:
+            rate = capture_start(rate, trigger, trigger_line);
+            if (rate == 0)
+            {
+                send_packet_response(ResponseErrorCode::InvalidFunction,
+                                     nullptr, 0);
+                return;
+            }
+
+            push_u32(rate);
+            break;
+
+        case CaptureCommand::Status:
+            push_u8((uint8_t)capture_state());
+            push_u8((uint8_t)spec.num_lines);
+            push_u32(capture_rate());
+            push_u32(capture_count());
+            break;
+
+        case CaptureCommand::Stop: capture_stop(); break;
+        case CaptureCommand::Read: push_capture_runs(first); break;
+
+        default:
+            send_packet_response(ResponseErrorCode::InvalidFunction, nullptr,
+                                 0);
+            return;
+    }
+
+    send_response_data();
+}
+
+void controls(DeviceContext* device)
+{
+    // NOTE(patrik): Bytes
+    //  4 bytes - Output levels, bit per GPIO
+    //  4 bytes - PhysicalControl::set calls
+    //  4 bytes - Commits (gpio_put_masked calls)
+    //  4 bytes - GPIO writes saved compared to a write per set
+    ControlBankStats stats = device->control_bank.stats();
+
+    begin_response_data();
+    push_u32(device->control_bank.outputs());
+    push_u32(stats.num_sets);
+    push_u32(stats.num_commits);
+    push_u32(stats.writes_saved);
+    send_response_data();
+}
+
+void snapshot(Packet* packet)
+{
+    // NOTE(patrik): Request
+    //  4 bytes (optional) - Version the host already has
+    //
+    // Bytes
+    //  4 bytes - Version, counts the status changes
+    //  16 bytes - Status, left out when the version matches the request
+    uint8_t buffer[STATUS_BUFFER_SIZE];
+    uint32_t version = status_read(buffer);
+
+    bool known = packet->data_len >= 4 && read_u32_from_data() == version;
+
+    begin_response_data();
+    push_u32(version);
+    if (!known)
+    {
+        for (size_t i = 0; i < sizeof(buffer); i++)
+            push_u8(buffer[i]);
+    }
+    send_response_data();
+}
+
+static uint8_t settings_buffer[SETTINGS_RESPONSE_SIZE];
+
+void settings(Packet* packet)
+{
+    // NOTE(patrik): Handled by the update thread, see docs/protocol.md for
+    // the layout
+    size_t len = 0;
+    ResponseErrorCode error_code =
+        settings_request(data_buffer, packet->data_len, settings_buffer, &len);
+
+    send_packet_response(error_code, settings_buffer, len);
+}
+
+void handle_ext_packet(Packet* packet, DeviceContext* device)
+{
+    switch ((ExtPacketType)packet->typ)
+    {
+        case ExtPacketType::Power: power(); break;
+        case ExtPacketType::CanStats: can_latency(packet); break;
+        case ExtPacketType::TaskStats: task_stats(); break;
+        case ExtPacketType::Profile: profile(packet, device); break;
+        case ExtPacketType::Latency: latency(packet); break;
+        case ExtPacketType::Trace: trace(packet); break;
+        case ExtPacketType::Schedule: schedule(packet); break;
+        case ExtPacketType::Boot: boot(); break;
+        case ExtPacketType::Supervisor: supervisor(); break;
+        case ExtPacketType::Capture: capture(packet); break;
+        case ExtPacketType::Controls: controls(device); break;
+        case ExtPacketType::Snapshot: snapshot(packet); break;
+        case ExtPacketType::Settings: settings(packet); break;
+
+        default:
+            send_packet_response(ResponseErrorCode::InvalidPacketType, nullptr,
+                                 0);
+            break;
+    }
+}
+
+bool data_available()
+{
+#if CFG_TUD_VENDOR
+    if (transport_available(Transport::Vendor) > 0)
+        return true;
+#endif
+
+    return transport_available(Transport::Cdc) > 0;
+}
+
+bool select_transport()
+{
+#if CFG_TUD_VENDOR
+    if (transport_available(Transport::Vendor) > 0)
+    {
+        transport = Transport::Vendor;
+        return true;
+    }
+#endif
+
+    if (transport_available(Transport::Cdc) > 0)
+    {
+        transport = Transport::Cdc;
+        return true;
+    }
+
+    return false;
+}
+
 void handle_packets(DeviceContext* device)
 {
-    if (tud_cdc_n_available(PORT_CMD) > 0)
+    if (select_transport())
     {
         uint8_t b = read_u8();
         if (b == PACKET_START)
         {
+            uint32_t receive_time = time_us_32();
+
             Packet packet = parse_packet();
+            packet.receive_time = receive_time;
 
             switch (packet.typ)
             {
@@ -225,11 +1099,10 @@ void handle_packets(DeviceContext* device)
                 case PacketType::Command: command(&packet, device); break;
                 case PacketType::Ping: ping(); break;
 
-                default:
-                    send_packet_response(ResponseErrorCode::InvalidPacketType,
-                                         nullptr, 0);
-                    break;
+                default: handle_ext_packet(&packet, device); break;
             }
+
+            trace_span(TRACE_PACKET_BEGIN, (uint16_t)packet.typ, receive_time);
         }
     }
 }
@@ -239,13 +1112,47 @@ void send_update() {}
 void com_thread(void* ptr)
 {
     DeviceContext* device = (DeviceContext*)ptr;
+    com_thread_handle = xTaskGetCurrentTaskHandle();
+    supervisor_register(SupervisedTask::Com, SUPERVISOR_DEADLINE_MS);
+
     while (1)
     {
+        supervisor_checkin(SupervisedTask::Com);
+
         handle_packets(device);
 
         if (send_updates)
             send_update();
 
-        vTaskDelay(1);
+        // NOTE(patrik): Sleep until the USB stack tells us there is data
+        if (!data_available())
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(SUPERVISOR_CHECKIN_MS));
     }
 }
+
+static void com_wake()
+{
+    if (com_thread_handle)
+        xTaskNotifyGive(com_thread_handle);
+}
+
+// NOTE(patrik): TinyUSB callbacks, run on the USB thread
+extern "C" void tud_cdc_rx_cb(uint8_t itf)
+{
+    if (itf == PORT_CMD)
+        com_wake();
+}
+
+extern "C" void tud_cdc_tx_complete_cb(uint8_t itf)
+{
+    if (itf == PORT_CMD)
+        com_wake();
+}
+
+#if CFG_TUD_VENDOR
+extern "C" void tud_vendor_rx_cb(uint8_t itf) { com_wake(); }
+extern "C" void tud_vendor_tx_cb(uint8_t itf, uint32_t sent_bytes)
+{
+    com_wake();
+}
+#endif
@@ -8,6 +8,28 @@ struct Packet
     PacketType typ;
     uint8_t data_len;
     uint16_t checksum;
+
+    // NOTE(patrik): When PACKET_START was read (us)
+    uint32_t receive_time;
+};
+
+// NOTE(patrik): Diagnostic packets only the firmware and dio know about,
+// numbered above the Speedwagon packet types. See docs/protocol.md
+enum class ExtPacketType : uint8_t
+{
+    Power = 0x80,
+    CanStats = 0x81,
+    TaskStats = 0x82,
+    Profile = 0x83,
+    Latency = 0x84,
+    Trace = 0x85,
+    Schedule = 0x86,
+    Boot = 0x87,
+    Supervisor = 0x88,
+    Capture = 0x89,
+    Controls = 0x8a,
+    Snapshot = 0x8b,
+    Settings = 0x8c,
 };
 
 void com_thread(void* ptr);
@@ -0,0 +1,76 @@
+#include "command.h"
+
+#include <string.h>
+#include "device.h"
+#include "profile.h"
+#include "supervisor.h"
+#include "trace.h"
+#include "util/spsc_queue.h"
+
+#include <FreeRTOS.h>
+#include <task.h>
+
+const size_t COMMAND_QUEUE_SIZE = 4;
+
+struct CommandRequest
+{
+    uint8_t cmd_index;
+    uint8_t num_params;
+    uint8_t params[MAX_CMD_PARAMS];
+
+    TaskHandle_t reply_to;
+};
+
+static SpscQueue<CommandRequest, COMMAND_QUEUE_SIZE> requests;
+static SpscQueue<CommandResult, COMMAND_QUEUE_SIZE> results;
+
+bool command_submit(uint8_t cmd_index, uint8_t* params, size_t num_params)
+{
+    if (num_params > MAX_CMD_PARAMS)
+        return false;
+
+    CommandRequest request;
+    request.cmd_index = cmd_index;
+    request.num_params = (uint8_t)num_params;
+    if (params && num_params > 0)
+        memcpy(request.params, params, num_params);
+
+    request.reply_to = xTaskGetCurrentTaskHandle();
+
+    if (!requests.push(request))
+        return false;
+
+    device_wake();
+    return true;
+}
+
+void command_wait_result(CommandResult* result)
+{
+    // NOTE(patrik): A slow command is the update thread's stall, not COM's,
+    // keep checking in while it runs
+    while (!results.pop(result))
+    {
+        supervisor_checkin(SupervisedTask::Com);
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(SUPERVISOR_CHECKIN_MS));
+    }
+}
+
+void command_process()
+{
+    CommandRequest request;
+    while (requests.pop(&request))
+    {
+        CommandResult result;
+        CmdFunction cmd = spec.funcs[request.cmd_index];
+
+        uint32_t start = profile_begin();
+        result.error_code = cmd(request.params, request.num_params);
+        profile_end(profile_command(request.cmd_index), start);
+        trace_span(TRACE_COMMAND_BEGIN, request.cmd_index, start);
+
+        // NOTE(patrik): The COM task only has one command in flight, so
+        // the result queue can't be full here
+        results.push(result);
+        xTaskNotifyGive(request.reply_to);
+    }
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "common.h"
+
+// NOTE(patrik): Command mailbox
+// The COM task decodes Command packets and submits them here, the update task
+// runs them at the start of its cycle (so CmdFunctions never race with
+// spec.update) and posts the result back for the response.
+
+const size_t MAX_CMD_PARAMS = 255;
+
+// NOTE(patrik): Timing is covered elsewhere, the CommandResponse histogram
+// (latency.h) from packet to response and the per-command profile
+// (profile.h) for the CmdFunction itself
+struct CommandResult
+{
+    ResponseErrorCode error_code;
+};
+
+// NOTE(patrik): Called from the COM task
+bool command_submit(uint8_t cmd_index, uint8_t* params, size_t num_params);
+void command_wait_result(CommandResult* result);
+
+// NOTE(patrik): Called from the update task
+void command_process();
@@ -8,6 +8,9 @@
 const uint8_t PORT_CMD = 0;
 const uint8_t PORT_DEBUG = 1;
 
+// NOTE(patrik): Deadlines are absolute time_us_64() timestamps
+const uint64_t NO_DEADLINE = UINT64_MAX;
+
 #define MAKE_VERSION(major, minor, patch)                                      \
     (((uint16_t)(major)) & 0x3f) << 10 | (((uint16_t)(minor)) & 0x3f) << 4 |   \
         ((uint16_t)(patch)) & 0xf
@@ -1,36 +1,423 @@
 #include "device.h"
 
+#include <atomic>
+#include "boot.h"
+#include "can.h"
+#include "command.h"
+#include "profile.h"
+#include "latency.h"
+#include "settings.h"
+#include "status.h"
+#include "supervisor.h"
+#include "trace.h"
+#include "util/fixed_rate.h"
+#include "util/gpio_irq.h"
+#include "util/spsc_queue.h"
+#include "util/status_light.h"
+
+#include <FreeRTOS.h>
+#include <task.h>
+
 #include <hardware/gpio.h>
+#include <hardware/sync.h>
+#include <hardware/timer.h>
+
+// NOTE(patrik): Longest the update thread sleeps when no device has asked
+// for a wakeup, a safety net in case an interrupt got lost and the
+// supervisor check in
+const uint32_t MAX_IDLE_WAIT_MS = SUPERVISOR_CHECKIN_MS;
+
+// NOTE(patrik): A control output changing longer than this after a line
+// edge isn't counted as a reaction to it
+const uint32_t EDGE_TIMEOUT_US = 1000 * 1000;
+
+static TaskHandle_t update_thread_handle;
+
+// NOTE(patrik): Time of the first line edge nobody has reacted to yet, 0 if
+// there is none
+static std::atomic<uint32_t> pending_edge_time{0};
+
+const size_t INPUT_EVENT_QUEUE_SIZE = 32;
+
+// NOTE(patrik): Filled by line_irq, drained by the update thread. Both run on
+// the control core.
+static SpscQueue<InputEvent, INPUT_EVENT_QUEUE_SIZE> input_events;
+static uint8_t pin_lines[NUM_BANK0_GPIOS];
+static uint32_t event_pins = 0;
+
+// NOTE(patrik): Bit per line, pressed as of the last edge that made it into
+// the queue. Once an edge has been dropped input_event_pop makes up the
+// missing ones from the actual levels, only with interrupts off.
+static uint32_t queued_down = 0;
+static std::atomic<bool> input_resync{false};
+static std::atomic<uint32_t> num_dropped_edges{0};
+
+static UpdateStats update_stats_data;
+static std::atomic<bool> update_stats_reset_requested{false};
 
 // NOTE(patrik): PhysicalLine
 
-void PhysicalLine::init(uint32_t pin)
+static void push_input_event(uint32_t pin, InputEdge edge, uint64_t time)
+{
+    InputEvent event;
+    event.time = time;
+    event.line = pin_lines[pin];
+    event.edge = edge;
+    if (!input_events.push(event))
+    {
+        num_dropped_edges.fetch_add(1, std::memory_order_relaxed);
+        input_resync.store(true, std::memory_order_relaxed);
+        return;
+    }
+
+    uint32_t bit = 1u << event.line;
+    if (edge == InputEdge::Press)
+        queued_down |= bit;
+    else
+        queued_down &= ~bit;
+}
+
+static void line_irq(uint32_t pin, uint32_t events)
+{
+    uint64_t time = time_us_64();
+
+    uint32_t now = (uint32_t)time;
+    uint32_t pending = pending_edge_time.load(std::memory_order_relaxed);
+    if (pending == 0 || now - pending > EDGE_TIMEOUT_US)
+        pending_edge_time.store(now ? now : 1, std::memory_order_relaxed);
+
+    if (event_pins & (1u << pin))
+    {
+        bool fall = events & GPIO_IRQ_EDGE_FALL;
+        bool rise = events & GPIO_IRQ_EDGE_RISE;
+
+        if (fall && rise)
+        {
+            // NOTE(patrik): A pulse shorter than the interrupt latency, the
+            // level the line settled on tells which edge came last
+            bool down = !gpio_get(pin);
+            push_input_event(pin, down ? InputEdge::Release : InputEdge::Press,
+                             time);
+            push_input_event(pin, down ? InputEdge::Press : InputEdge::Release,
+                             time);
+        }
+        else if (fall)
+        {
+            push_input_event(pin, InputEdge::Press, time);
+        }
+        else if (rise)
+        {
+            push_input_event(pin, InputEdge::Release, time);
+        }
+    }
+
+    device_wake_from_isr();
+}
+
+void PhysicalLine::init(uint32_t pin, size_t index, bool events)
 {
     m_pin = pin;
 
+    pin_lines[pin] = (uint8_t)index;
+    if (events)
+        event_pins |= 1u << pin;
+
     gpio_init(m_pin);
     gpio_set_dir(m_pin, GPIO_IN);
     gpio_pull_up(m_pin);
+
+    gpio_irq_set_handler(m_pin, GPIO_IRQ_EDGE_FALL | GPIO_IRQ_EDGE_RISE,
+                         line_irq);
 }
 
 bool PhysicalLine::get() { return !gpio_get(m_pin); }
 
 // NOTE(patrik): PhysicalControl
 
-void PhysicalControl::init(uint32_t pin)
+void PhysicalControl::init(uint32_t pin, ControlBank* bank)
 {
     m_pin = pin;
+    m_bank = bank;
+
+    // NOTE(patrik): After a watchdog reset the output comes back in the
+    // state it was in, not off
+    m_is_on = supervisor_retained_control(pin);
 
     gpio_init(pin);
+    gpio_put(pin, m_is_on);
     gpio_set_dir(pin, GPIO_OUT);
-    gpio_put(pin, false);
+
+    m_bank->init_pin(pin, m_is_on);
 }
 
 void PhysicalControl::set(bool on)
 {
+    trace_event(TRACE_CONTROL_SET, (uint16_t)(m_pin | (uint32_t)on << 8));
+
+    if (on != m_is_on)
+        supervisor_retain_control(m_pin, on);
+
     m_is_on = on;
-    // TODO(patrik): Dont call if not changed?
-    gpio_put(m_pin, m_is_on);
+    m_bank->set(m_pin, m_is_on);
 }
 
 void PhysicalControl::toggle() { set(!m_is_on); }
+
+// NOTE(patrik): Device runtime
+
+void init_device(DeviceContext* context)
+{
+    context->num_lines = spec.num_lines;
+    context->lines = spec.state.lines;
+    context->num_controls = spec.num_controls;
+    context->controls = spec.state.controls;
+
+    for (int i = 0; i < spec.num_lines; i++)
+    {
+        bool events = (spec.event_lines & (1u << i)) != 0;
+        context->lines[i].init(spec.lines[i], i, events);
+    }
+
+    for (int i = 0; i < spec.num_controls; i++)
+        context->controls[i].init(spec.controls[i], &context->control_bank);
+
+    boot_mark(BootPhase::ControlsReady);
+}
+
+void device_wake()
+{
+    if (update_thread_handle)
+        xTaskNotifyGive(update_thread_handle);
+}
+
+void device_wake_from_isr()
+{
+    if (!update_thread_handle)
+        return;
+
+    BaseType_t woken = pdFALSE;
+    vTaskNotifyGiveFromISR(update_thread_handle, &woken);
+    portYIELD_FROM_ISR(woken);
+}
+
+static TickType_t ticks_until(uint64_t deadline)
+{
+    uint64_t now = time_us_64();
+    if (deadline <= now)
+        return 0;
+
+    const uint64_t tick_us = 1000000 / configTICK_RATE_HZ;
+    uint64_t ticks = (deadline - now + tick_us - 1) / tick_us;
+
+    const uint64_t max_ticks = pdMS_TO_TICKS(MAX_IDLE_WAIT_MS);
+    return (TickType_t)(ticks < max_ticks ? ticks : max_ticks);
+}
+
+static void run_update(DeviceContext* device, uint64_t now)
+{
+    uint32_t start = profile_begin();
+    spec.update(device, now);
+    profile_end(profile_handler(ProfileHandler::Update), start);
+    trace_span(TRACE_HANDLER_BEGIN, (uint16_t)ProfileHandler::Update, start);
+}
+
+// NOTE(patrik): Runs the update for the tick that's due (if any) and returns
+// when the next one is (see fixed_rate_next), a late update doesn't push the
+// following ones back.
+static uint64_t run_fixed_rate(DeviceContext* device, uint64_t tick)
+{
+    uint64_t now = time_us_64();
+    if (now < tick)
+        return tick;
+
+    uint32_t lateness = (uint32_t)(now - tick);
+    update_stats_data.num_updates++;
+    update_stats_data.last_lateness = lateness;
+    if (lateness > update_stats_data.max_lateness)
+        update_stats_data.max_lateness = lateness;
+    latency_record(LatencyPoint::UpdateLateness, lateness);
+
+    run_update(device, tick);
+
+    uint32_t missed;
+    uint64_t next =
+        fixed_rate_next(tick, time_us_64(), spec.update_period, &missed);
+    update_stats_data.num_overruns += missed;
+
+    return next;
+}
+
+// NOTE(patrik): The outputs only change here, so this is where the first
+// output and the edge to output latency are measured
+static void commit_controls(DeviceContext* device)
+{
+    if (!device->control_bank.commit())
+        return;
+
+    boot_mark(BootPhase::FirstOutput);
+
+    uint32_t edge = pending_edge_time.load(std::memory_order_relaxed);
+    if (edge)
+    {
+        pending_edge_time.store(0, std::memory_order_relaxed);
+
+        uint32_t latency = time_us_32() - edge;
+        if (latency <= EDGE_TIMEOUT_US)
+            latency_record(LatencyPoint::EdgeToOutput, latency);
+    }
+}
+
+void update_thread(void* ptr)
+{
+    DeviceContext* device = (DeviceContext*)ptr;
+    update_thread_handle = xTaskGetCurrentTaskHandle();
+    boot_mark(BootPhase::SchedulerStarted);
+    supervisor_register(SupervisedTask::Update, SUPERVISOR_DEADLINE_MS);
+
+    // NOTE(patrik): Take the line and CAN interrupts on this core
+    gpio_irq_enable();
+
+    spec.init(device);
+    boot_mark(BootPhase::DeviceReady);
+
+    uint64_t next_tick = time_us_64();
+
+    while (true)
+    {
+        supervisor_checkin(SupervisedTask::Update);
+
+        if (update_stats_reset_requested.load())
+        {
+            update_stats_reset_requested.store(false);
+            update_stats_data = UpdateStats{};
+            num_dropped_edges.store(0, std::memory_order_relaxed);
+        }
+
+        command_process();
+        settings_process();
+
+        // NOTE(patrik): Before the update, so whatever on_can_message
+        // changed is seen by the update in the same pass instead of whenever
+        // the thread wakes up next
+        can_update();
+
+        uint64_t deadline;
+        if (spec.update_period > 0)
+        {
+            // NOTE(patrik): Commands and CAN still wake us up between ticks,
+            // those get handled without running the device update
+            next_tick = run_fixed_rate(device, next_tick);
+            deadline = next_tick;
+        }
+        else
+        {
+            device->next_update = NO_DEADLINE;
+            run_update(device, time_us_64());
+            deadline = device->next_update;
+        }
+
+        // NOTE(patrik): Once per pass, after everything that can change the
+        // device's state
+        status_publish();
+
+        // NOTE(patrik): Status lights keep their own schedule on top of the
+        // device's, they only cost anything when a transition is due
+        uint64_t lights_deadline = status_lights_update(time_us_64());
+        if (lights_deadline < deadline)
+            deadline = lights_deadline;
+
+        // NOTE(patrik): Everything the commands, the update and the CAN
+        // handler did to the outputs goes out together
+        commit_controls(device);
+
+        // NOTE(patrik): Last, a flush stalls the whole chip and everything
+        // this pass owed the outside world is already out
+        uint64_t settings_deadline = settings_update(time_us_64());
+        if (settings_deadline < deadline)
+            deadline = settings_deadline;
+
+        // NOTE(patrik): Sleep until the next deadline or until something
+        // (CAN, a line edge, a command) wakes us up
+        uint64_t sleep_start = time_us_64();
+        ulTaskNotifyTake(pdTRUE, ticks_until(deadline));
+
+        // NOTE(patrik): Only deadlines we actually slept towards, "run again
+        // right away" (deadline in the past) isn't late. Fixed rate ticks
+        // are recorded when they run.
+        uint64_t now = time_us_64();
+        if (spec.update_period == 0 && deadline != NO_DEADLINE &&
+            deadline > sleep_start && now >= deadline)
+        {
+            latency_record(LatencyPoint::UpdateLateness,
+                           (uint32_t)(now - deadline));
+        }
+    }
+}
+
+UpdateStats update_stats()
+{
+    UpdateStats stats = update_stats_data;
+    stats.num_dropped_edges = num_dropped_edges.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void update_stats_reset() { update_stats_reset_requested = true; }
+
+// NOTE(patrik): Event lines that read pressed right now, bit per line
+static uint32_t event_lines_down()
+{
+    uint32_t levels = gpio_get_all();
+
+    uint32_t down = 0;
+    for (size_t i = 0; i < spec.num_lines; i++)
+    {
+        bool active_low = (levels & (1u << spec.lines[i])) == 0;
+        if ((spec.event_lines & (1u << i)) && active_low)
+            down |= 1u << i;
+    }
+
+    return down;
+}
+
+bool input_event_pop(InputEvent* event)
+{
+    if (input_events.pop(event))
+        return true;
+
+    if (!input_resync.load(std::memory_order_relaxed))
+        return false;
+
+    // NOTE(patrik): The queue ran over, so the device may have missed an
+    // edge (a lost release would leave a button held forever). With the
+    // queue drained, every line that doesn't read what its last queued edge
+    // said gets an edge made up for it, one per call.
+    bool found = false;
+    uint32_t status = save_and_disable_interrupts();
+
+    if (input_events.pop(event))
+    {
+        found = true;
+    }
+    else
+    {
+        uint32_t diff = event_lines_down() ^ queued_down;
+        if (diff == 0)
+        {
+            input_resync.store(false, std::memory_order_relaxed);
+        }
+        else
+        {
+            uint32_t bit = diff & -diff;
+            queued_down ^= bit;
+
+            event->time = time_us_64();
+            event->line = (uint8_t)__builtin_ctz(bit);
+            event->edge =
+                queued_down & bit ? InputEdge::Press : InputEdge::Release;
+            found = true;
+        }
+    }
+
+    restore_interrupts(status);
+    return found;
+}
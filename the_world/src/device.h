@@ -1,17 +1,25 @@
 #pragma once
 
+#include <iterator>
+
 #include "common.h"
+#include "can.h"
 #include "func.h"
+#include "profile.h"
+#include "util/control_bank.h"
 
 const size_t STATUS_BUFFER_SIZE = 16;
 const size_t MAX_LINES = 16;
-const size_t MAX_CONTROLS = 16;
-const size_t MAX_CMDS = 50;
+// NOTE(patrik): Identify reports the number of commands in a single byte
+const size_t MAX_CMDS = 255;
+const uint32_t NUM_GPIO_PINS = 30;
 
 class PhysicalLine
 {
 public:
-    void init(uint32_t pin);
+    // NOTE(patrik): With events the line's edges are queued as InputEvents
+    // (see input_event_pop), otherwise they only wake the update thread
+    void init(uint32_t pin, size_t index, bool events);
 
     bool get();
 
@@ -19,10 +27,12 @@ private:
     uint32_t m_pin = 0xffffffff;
 };
 
+// NOTE(patrik): Changes only reach the pin on the next ControlBank::commit,
+// the update thread commits once per pass
 class PhysicalControl
 {
 public:
-    void init(uint32_t pin);
+    void init(uint32_t pin, ControlBank* bank);
 
     void set(bool on);
     void toggle();
@@ -32,42 +42,202 @@ public:
 private:
     uint32_t m_pin = 0xffffffff;
     bool m_is_on = false;
+    ControlBank* m_bank = nullptr;
 };
 
 struct DeviceContext
 {
     size_t num_lines;
-    PhysicalLine lines[MAX_LINES];
+    PhysicalLine* lines;
 
     size_t num_controls;
-    PhysicalControl controls[MAX_CONTROLS];
+    PhysicalControl* controls;
+    ControlBank control_bank;
+
+    // NOTE(patrik): When the update thread should run next if nothing else
+    // wakes it up, devices lower this from spec.update. Only used by devices
+    // without an update_period.
+    uint64_t next_update;
+
+    void schedule_update(uint64_t time)
+    {
+        if (time < next_update)
+            next_update = time;
+    }
+};
 
-    size_t num_cmds;
+enum class InputEdge : uint8_t
+{
+    // NOTE(patrik): Lines are active low, pressed is the falling edge
+    Press,
+    Release,
+};
+
+// NOTE(patrik): Timestamped by the GPIO interrupt, so the time is when the
+// edge happened and not when the update thread got to it
+struct InputEvent
+{
+    uint64_t time;
+    uint8_t line; // Index into spec.lines
+    InputEdge edge;
 };
 
 typedef void (*InitFunction)(DeviceContext* device);
-typedef void (*UpdateFunction)(DeviceContext* device);
+// NOTE(patrik): now is the time the update was scheduled for, devices
+// should use it instead of reading the timer themselves
+typedef void (*UpdateFunction)(DeviceContext* device, uint64_t now);
 typedef void (*GetStatusFunction)(uint8_t* buffer);
 typedef void (*OnCanMessageFunction)(uint32_t can_id, uint8_t* data,
                                      size_t len);
 
+// NOTE(patrik): Runtime state for one device, sized by the device file with
+// DeviceStorage and handed to the runtime through the spec
+struct DeviceState
+{
+    PhysicalLine* lines;
+    PhysicalControl* controls;
+    ProfileStat* command_stats;
+};
+
+// NOTE(patrik): There are no zero sized arrays, a device without lines
+// (or controls, commands) still gets one entry
+template <size_t NumLines, size_t NumControls, size_t NumCmds>
+struct DeviceStorage
+{
+    PhysicalLine lines[NumLines ? NumLines : 1];
+    PhysicalControl controls[NumControls ? NumControls : 1];
+    ProfileStat command_stats[NumCmds ? NumCmds : 1];
+
+    constexpr DeviceState state()
+    {
+        return DeviceState{lines, controls, command_stats};
+    }
+};
+
+// NOTE(patrik): Every device defines its spec as constexpr with the pins and
+// commands in arrays of their own, then runs VALIDATE_DEVICE_SPEC on it:
+//
+//   static constexpr uint32_t lines[] = {10, 11};
+//   static constexpr uint32_t controls[] = {16};
+//   static constexpr CmdFunction funcs[] = {set_relay};
+//
+//   static DeviceStorage<std::size(lines), std::size(controls),
+//                        std::size(funcs)>
+//       storage;
+//
+//   constexpr DeviceSpec spec = {
+//       ...
+//       .num_lines = std::size(lines),
+//       .lines = lines,
+//       ...
+//       .num_cmds = std::size(funcs),
+//       .funcs = funcs,
+//       .state = storage.state(),
+//   };
+//
+//   VALIDATE_DEVICE_SPEC(spec);
 struct DeviceSpec
 {
     const char* name;
     uint16_t version;
 
     size_t num_lines;
-    uint32_t lines[MAX_LINES];
+    const uint32_t* lines;
+    // NOTE(patrik): Bit per entry in lines, edges on these lines get queued
+    // as InputEvents
+    uint32_t event_lines;
 
     size_t num_controls;
-    uint32_t controls[MAX_CONTROLS];
+    const uint32_t* controls;
+
+    // NOTE(patrik): Period between updates (us). With 0 update only runs
+    // when the device is woken up (CAN, line edges, commands) or hits a
+    // deadline from schedule_update.
+    uint32_t update_period;
 
     InitFunction init;
     UpdateFunction update;
     GetStatusFunction get_status;
     OnCanMessageFunction on_can_message;
 
-    CmdFunction funcs[MAX_CMDS];
+    size_t num_cmds;
+    const CmdFunction* funcs;
+
+    DeviceState state;
 };
 
 extern const DeviceSpec spec;
+
+constexpr bool spec_pins_in_range(const uint32_t* pins, size_t num_pins)
+{
+    for (size_t i = 0; i < num_pins; i++)
+    {
+        if (pins[i] >= NUM_GPIO_PINS)
+            return false;
+    }
+
+    return true;
+}
+
+// NOTE(patrik): Bit per pin used by the device, 0 if a pin is used twice
+constexpr uint32_t spec_pin_mask(const DeviceSpec& spec)
+{
+    uint32_t used = 0;
+
+    for (size_t i = 0; i < spec.num_lines + spec.num_controls; i++)
+    {
+        uint32_t pin = i < spec.num_lines ? spec.lines[i]
+                                          : spec.controls[i - spec.num_lines];
+        if (used & (1u << pin))
+            return 0;
+
+        used |= 1u << pin;
+    }
+
+    return used;
+}
+
+#define VALIDATE_DEVICE_SPEC(spec)                                             \
+    static_assert(spec.num_lines <= MAX_LINES, "Too many lines");              \
+    static_assert(spec.num_cmds <= MAX_CMDS, "Too many commands");             \
+    static_assert((spec.event_lines >> spec.num_lines) == 0,                   \
+                  "Event line out of range");                                  \
+    static_assert(spec_pins_in_range(spec.lines, spec.num_lines) &&            \
+                      spec_pins_in_range(spec.controls, spec.num_controls),    \
+                  "Pin out of range");                                         \
+    static_assert(spec.num_lines + spec.num_controls == 0 ||                   \
+                      spec_pin_mask(spec) != 0,                                \
+                  "Pin used more than once");                                  \
+    static_assert((spec_pin_mask(spec) & CAN_PINS) == 0,                       \
+                  "Pin used by CAN")
+
+// NOTE(patrik): Fixed rate schedule stats, lateness is how long after its
+// scheduled time an update started (us). An overrun is a period that got
+// skipped because the update before it ran past it. Dropped edges didn't fit
+// in the input event queue, for any device.
+struct UpdateStats
+{
+    uint32_t num_updates;
+    uint32_t num_overruns;
+    uint32_t last_lateness;
+    uint32_t max_lateness;
+    uint32_t num_dropped_edges;
+};
+
+// NOTE(patrik): Same rules as can_stats, read without a lock and the reset is
+// done by the update task on its next pass
+UpdateStats update_stats();
+void update_stats_reset();
+
+void init_device(DeviceContext* context);
+void update_thread(void* ptr);
+
+// NOTE(patrik): Next queued edge from the lines in spec.event_lines, oldest
+// first. Only from the update thread. Edges are dropped while the queue is
+// full, after that the lines are brought back in line with their levels
+// with made up edges (timestamped when they are popped).
+bool input_event_pop(InputEvent* event);
+
+// NOTE(patrik): Wake the update thread (CAN, line edges, commands)
+void device_wake();
+void device_wake_from_isr();
@@ -26,17 +26,14 @@ static void init(DeviceContext* device)
     context.light.init(device->controls + 0);
 }
 
-static void update(DeviceContext* device)
+static void update(DeviceContext* device, uint64_t now)
 {
-    context.light.update();
+    context.light.set(context.status.is_reverse_lights_on);
+
     if (context.status.is_reverse_camera_on)
-    {
-        context.light.blink(250 * 1000);
-    }
+        context.light.play(LIGHT_BLINK_FAST);
     else
-    {
-        context.light.set(context.status.is_reverse_lights_on);
-    }
+        context.light.stop(LIGHT_BLINK_FAST.priority);
 }
 
 static void get_status(uint8_t* buffer)
@@ -71,24 +68,35 @@ DEFINE_CMD(test)
     return ResponseErrorCode::Success;
 }
 
-const DeviceSpec spec = {
+static constexpr uint32_t controls[] = {PICO_DEFAULT_LED_PIN};
+
+static constexpr CmdFunction funcs[] = {
+    test, // 0x00
+};
+
+static DeviceStorage<0, std::size(controls), std::size(funcs)> storage;
+
+constexpr DeviceSpec spec = {
     .name = "RSNav Controller",
     .version = MAKE_VERSION(0, 1, 0),
 
     .num_lines = 0,
-    .lines = {},
+    .lines = nullptr,
+
+    .num_controls = std::size(controls),
+    .controls = controls,
 
-    .num_controls = 1,
-    .controls = {PICO_DEFAULT_LED_PIN},
+    .update_period = 0,
 
     .init = init,
     .update = update,
     .get_status = get_status,
     .on_can_message = on_can_message,
 
-    .funcs =
-        {
-            test,
-            nullptr, // LAST
-        },
+    .num_cmds = std::size(funcs),
+    .funcs = funcs,
+
+    .state = storage.state(),
 };
+
+VALIDATE_DEVICE_SPEC(spec);
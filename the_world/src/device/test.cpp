@@ -1,48 +1,63 @@
+#include <stdio.h>
+
 #include "speedwagon.h"
-#include "util/button.h"
+#include "util/button_bank.h"
 #include "util/status_light.h"
 #include "device.h"
 #include "func.h"
 #include "can.h"
+#include "settings.h"
 
 struct Context
 {
     PhysicalControl* relay;
     PhysicalControl* backup_lamps;
     StatusLight light;
-    Button button;
+    ButtonBank buttons;
 
     bool test;
 
+    uint32_t status_can_id;
+    uint64_t send_update_period;
     uint64_t send_update_timer;
 
     void update_status()
     {
-        if (backup_lamps->is_on())
-        {
-            light.blink_count(500 * 1000, 2);
-            return;
-        }
-
         light.set(relay->is_on());
+
+        if (backup_lamps->is_on())
+            light.play(LIGHT_DOUBLE_BLINK);
     }
 };
 
 static Context context;
 
-void button_test(const char* name, Button* button)
+const size_t BUTTON_LINE = 2;
+const size_t BUTTON = 0;
+
+// NOTE(patrik): Pins stay in the spec, they are checked at compile time (see
+// VALIDATE_DEVICE_SPEC)
+enum TestSetting : uint16_t
 {
-    if (button->is_click())
-        printf("%s: Click\n", name);
-    if (button->is_released())
-        printf("%s: Released\n", name);
-
-    if (button->is_single_click())
-        printf("%s: Single click\n", name);
-    if (button->is_long_click())
-        printf("%s: Long click\n", name);
-    if (button->is_double_click())
-        printf("%s: Double click\n", name);
+    SETTING_STATUS_CAN_ID = SETTING_DEVICE + 0,
+    SETTING_STATUS_PERIOD = SETTING_DEVICE + 1, // ms
+    SETTING_DEBOUNCE = SETTING_DEVICE + 2,      // ms
+    SETTING_SINGLE_CLICK = SETTING_DEVICE + 3,  // ms
+    SETTING_LONG_CLICK = SETTING_DEVICE + 4,    // ms
+};
+
+static const char* button_event_name(ButtonEventType type)
+{
+    switch (type)
+    {
+        case ButtonEventType::Press: return "Click";
+        case ButtonEventType::Release: return "Released";
+        case ButtonEventType::SingleClick: return "Single click";
+        case ButtonEventType::DoubleClick: return "Double click";
+        case ButtonEventType::LongClick: return "Long click";
+    }
+
+    return "Unknown";
 }
 
 void init(DeviceContext* device)
@@ -50,37 +65,79 @@ void init(DeviceContext* device)
     context.relay = &device->controls[3];
     context.backup_lamps = &device->controls[5];
     context.light.init(&device->controls[2]);
+    context.buttons.init(1);
+
+    // NOTE(patrik): A status period of 0 would send a frame every pass and
+    // a debounce or click that long makes the button useless
+    settings_limit_u32(SETTING_STATUS_CAN_ID, 0, 0x7ff);
+    settings_limit_u32(SETTING_STATUS_PERIOD, 10, 60 * 1000);
+    settings_limit_u32(SETTING_DEBOUNCE, 1, 500);
+    settings_limit_u32(SETTING_SINGLE_CLICK, 50, 2000);
+    settings_limit_u32(SETTING_LONG_CLICK, 100, 10 * 1000);
+
+    context.status_can_id = settings_get_u32(SETTING_STATUS_CAN_ID, 0x100);
+    context.send_update_period =
+        settings_get_u32(SETTING_STATUS_PERIOD, 100) * 1000ull;
+
+    ButtonTiming timing = DEFAULT_BUTTON_TIMING;
+    timing.debounce =
+        settings_get_u32(SETTING_DEBOUNCE, timing.debounce / 1000) * 1000;
+    timing.single_click =
+        settings_get_u32(SETTING_SINGLE_CLICK, timing.single_click / 1000) *
+        1000;
+    timing.long_click =
+        settings_get_u32(SETTING_LONG_CLICK, timing.long_click / 1000) * 1000;
+    context.buttons.set_timing(BUTTON, timing);
 }
 
-void update(DeviceContext* device)
+static void handle_button(const ButtonEvent& event)
 {
-    uint64_t current_time = time_us_64();
-
-    bool state = device->lines[2].get();
-    context.button.update(state);
-    context.light.update();
-
-    if (context.button.is_single_click())
+    if (event.type == ButtonEventType::SingleClick)
     {
         context.relay->toggle();
         context.update_status();
     }
 
-    if (context.button.is_long_click())
+    if (event.type == ButtonEventType::LongClick)
     {
         context.test = !context.test;
     }
 
-    if (current_time - context.send_update_timer > 100 * 1000)
+    printf("Button %u: %s\n", event.button, button_event_name(event.type));
+}
+
+void update(DeviceContext* device, uint64_t now)
+{
+    // NOTE(patrik): Every edge goes through the button at the time it
+    // happened, then the buttons get to time out (debounce, clicks) at now
+    InputEvent input;
+    while (input_event_pop(&input))
+    {
+        if (input.line != BUTTON_LINE)
+            continue;
+
+        context.buttons.edge(BUTTON, input.edge == InputEdge::Press,
+                             input.time);
+    }
+
+    context.buttons.update(now);
+
+    ButtonEvent event;
+    while (context.buttons.pop_event(&event))
+        handle_button(event);
+
+    if (now - context.send_update_timer >= context.send_update_period)
     {
         uint8_t status =
             (uint8_t)context.test << 1 | (uint8_t)context.relay->is_on() << 0;
         uint8_t data[] = {status};
-        send_can_message(0x100, data, sizeof(data));
-        context.send_update_timer = current_time;
+        send_can_message(context.status_can_id, data, sizeof(data));
+        context.send_update_timer = now;
     }
 
-    button_test("Button", &context.button);
+    device->schedule_update(context.buttons.next_deadline());
+    device->schedule_update(context.send_update_timer +
+                            context.send_update_period);
 }
 
 void get_status(uint8_t* buffer)
@@ -125,25 +182,39 @@ DEFINE_CMD(change_backup_lamps)
     return ResponseErrorCode::Success;
 }
 
-const DeviceSpec spec = {
+static constexpr uint32_t lines[] = {10, 11, 12, 19, 20, 21};
+static constexpr uint32_t controls[] = {9, 7, 8, 16, 17, 18};
+
+static constexpr CmdFunction funcs[] = {
+    change_first_relay,  // 0x00
+    change_backup_lamps, // 0x01
+};
+
+static DeviceStorage<std::size(lines), std::size(controls), std::size(funcs)>
+    storage;
+
+constexpr DeviceSpec spec = {
     .name = "Test Controller",
     .version = MAKE_VERSION(0, 1, 0),
 
-    .num_lines = 6,
-    .lines = {10, 11, 12, 19, 20, 21},
+    .num_lines = std::size(lines),
+    .lines = lines,
+    .event_lines = 1 << BUTTON_LINE,
 
-    .num_controls = 6,
-    .controls = {5, 7, 8, 16, 17, 18},
+    .num_controls = std::size(controls),
+    .controls = controls,
+
+    .update_period = 0,
 
     .init = init,
     .update = update,
     .get_status = get_status,
     .on_can_message = on_can_message,
 
-    .funcs =
-        {
-            change_first_relay,  // 0x00
-            change_backup_lamps, // 0x01
-            nullptr,             // LAST
-        },
+    .num_cmds = std::size(funcs),
+    .funcs = funcs,
+
+    .state = storage.state(),
 };
+
+VALIDATE_DEVICE_SPEC(spec);
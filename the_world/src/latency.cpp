@@ -0,0 +1,8 @@
+#include "latency.h"
+
+static Histogram histograms[(size_t)LatencyPoint::Count];
+
+Histogram* latency_histogram(LatencyPoint point)
+{
+    return &histograms[(size_t)point];
+}
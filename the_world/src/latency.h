@@ -0,0 +1,31 @@
+#pragma once
+
+#include "common.h"
+#include "util/histogram.h"
+
+// NOTE(patrik): Always-on latency histograms (us). Each one is recorded
+// from a single task:
+//  UpdateLateness  - How late the update thread woke up after the deadline
+//                    a device asked for, or after the scheduled tick for
+//                    devices with an update_period
+//  CanRxDispatch   - MCP2515 INT edge until the frame reaches
+//                    spec.on_can_message (update thread)
+//  CommandResponse - Command packet read until its response is sent (COM)
+//  EdgeToOutput    - Line edge until the next control output change, within
+//                    EDGE_TIMEOUT_US (update thread)
+enum class LatencyPoint : uint8_t
+{
+    UpdateLateness,
+    CanRxDispatch,
+    CommandResponse,
+    EdgeToOutput,
+
+    Count,
+};
+
+Histogram* latency_histogram(LatencyPoint point);
+
+inline void latency_record(LatencyPoint point, uint32_t value)
+{
+    latency_histogram(point)->record(value);
+}
@@ -7,7 +7,10 @@
 
 #include "com.h"
 #include "can.h"
+#include "boot.h"
 #include "device.h"
+#include "settings.h"
+#include "supervisor.h"
 
 #include "util/serial_number.h"
 #include "util/status_light.h"
@@ -35,78 +38,104 @@ stdio_driver_t debug_driver = {
     .out_chars = debug_driver_output,
 };
 
-void init_system()
+// NOTE(patrik): Only what the device needs to react to the car runs before
+// the scheduler, settings first since both read theirs in init, then outputs
+// so the controls are in a known state, then CAN. USB comes up later on its
+// own thread (see usb_thread), a car without a host plugged in never waits
+// on it.
+void init_system(DeviceContext* device)
 {
-    serial_number_init();
-
-    board_init();
-    tusb_init();
+    supervisor_init();
+    settings_init();
 
+    init_device(device);
     can_init();
 
     stdio_uart_init();
-    stdio_set_driver_enabled(&debug_driver, true);
 }
 
-void usb_thread(void* ptr)
+// NOTE(patrik): CAN gets the highest priority since the MCP2515 only has
+// two receive buffers, USB just NAKs and the host retries if we are late.
+// COM sits at the bottom, it only waits on the other two anyway.
+const UBaseType_t UPDATE_THREAD_PRIORITY = tskIDLE_PRIORITY + 3;
+const UBaseType_t USB_THREAD_PRIORITY = tskIDLE_PRIORITY + 2;
+const UBaseType_t COM_THREAD_PRIORITY = tskIDLE_PRIORITY + 1;
+
+// NOTE(patrik): With SMP the update thread (device logic + CAN) gets core 1
+// to itself, USB and COM share core 0. They only talk through the lock-free
+// command mailbox and task notifications.
+const UBaseType_t IO_CORE = 0;
+const UBaseType_t CONTROL_CORE = 1;
+
+// NOTE(patrik): Stack sizes in words. Starting points, tune them with the
+// high water marks from the TaskStats packet (dio run ... tasks).
+//  USB    - tud_task and the TinyUSB callbacks
+//  Update - device update, commands (CommandRequest is ~270 bytes) and
+//           printf from the devices. The settings request/response pair is
+//           static, see settings.cpp
+//  COM    - packet parsing plus a CommandRequest while submitting, the
+//           settings buffers are static here too
+const uint32_t USB_THREAD_STACK_SIZE = 384;
+const uint32_t UPDATE_THREAD_STACK_SIZE = 512;
+const uint32_t COM_THREAD_STACK_SIZE = 512;
+
+static StackType_t usb_thread_stack[USB_THREAD_STACK_SIZE];
+static StackType_t update_thread_stack[UPDATE_THREAD_STACK_SIZE];
+static StackType_t com_thread_stack[COM_THREAD_STACK_SIZE];
+
+static StaticTask_t usb_thread_tcb;
+static StaticTask_t update_thread_tcb;
+static StaticTask_t com_thread_tcb;
+
+static TaskHandle_t create_thread(TaskFunction_t func, const char* name,
+                                  void* param, UBaseType_t priority,
+                                  UBaseType_t core, StackType_t* stack,
+                                  uint32_t stack_size, StaticTask_t* tcb)
 {
-    do
-    {
-        tud_task();
-        vTaskDelay(1);
-    } while (1);
+#if configNUM_CORES > 1 && configUSE_CORE_AFFINITY
+    return xTaskCreateStaticAffinitySet(func, name, stack_size, param,
+                                        priority, stack, tcb, 1 << core);
+#else
+    return xTaskCreateStatic(func, name, stack_size, param, priority, stack,
+                             tcb);
+#endif
 }
 
-void update_thread(void* ptr)
+void usb_thread(void* ptr)
 {
-    DeviceContext* device = (DeviceContext*)ptr;
-    spec.init(device);
+    // NOTE(patrik): The USB interrupt ends up on the core that calls
+    // tusb_init, which is this one. COM shares the core at a lower priority
+    // so it can't touch TinyUSB before this is done.
+    serial_number_init();
 
-    while (true)
-    {
-        spec.update(device);
-        can_update();
+    board_init();
+    tusb_init();
+
+    stdio_set_driver_enabled(&debug_driver, true);
+    boot_mark(BootPhase::UsbReady);
+
+    supervisor_register(SupervisedTask::Usb, SUPERVISOR_DEADLINE_MS);
 
-        vTaskDelay(1);
-    }
+    // NOTE(patrik): With OPT_OS_FREERTOS tud_task_ext() blocks until the USB
+    // interrupt queues an event, the timeout is only there to check in
+    do
+    {
+        supervisor_checkin(SupervisedTask::Usb);
+        tud_task_ext(SUPERVISOR_CHECKIN_MS, false);
+    } while (1);
 }
 
+extern "C" void tud_mount_cb() { boot_mark(BootPhase::UsbMounted); }
+
 static TaskHandle_t usb_thread_handle;
-static TaskHandle_t can_thread_handle;
 static TaskHandle_t update_thread_handle;
 static TaskHandle_t com_thread_handle;
 
-void init_device(DeviceContext* context)
-{
-    context->num_lines = spec.num_lines;
-    context->num_controls = spec.num_controls;
-
-    for (int i = 0; i < spec.num_lines; i++)
-        context->lines[i].init(spec.lines[i]);
-
-    for (int i = 0; i < spec.num_controls; i++)
-        context->controls[i].init(spec.controls[i]);
-
-    size_t num_cmds = 0;
-
-    for (int i = 0;; i++)
-    {
-        if (spec.funcs[i])
-            num_cmds++;
-        else
-            break;
-    }
-
-    context->num_cmds = num_cmds;
-}
-
 static DeviceContext device_context;
 
 int main()
 {
-    init_system();
-
-    init_device(&device_context);
+    init_system(&device_context);
 
     // SP Device:
     //  - COM
@@ -117,24 +146,53 @@ int main()
     //  - Check Can bus
     //  - Check pins
 
-    xTaskCreate(usb_thread, "USB Thread", configMINIMAL_STACK_SIZE, nullptr,
-                tskIDLE_PRIORITY + 4, &usb_thread_handle);
-    // xTaskCreate(can_thread, "Can Thread", configMINIMAL_STACK_SIZE, nullptr,
-    //             tskIDLE_PRIORITY + 3, &can_thread_handle);
-    xTaskCreate(update_thread, "Update Thread", configMINIMAL_STACK_SIZE,
-                &device_context, tskIDLE_PRIORITY + 2, &update_thread_handle);
-    xTaskCreate(com_thread, "COM Thread", configMINIMAL_STACK_SIZE,
-                &device_context, tskIDLE_PRIORITY + 1, &com_thread_handle);
-
+    update_thread_handle = create_thread(
+        update_thread, "Update Thread", &device_context, UPDATE_THREAD_PRIORITY,
+        CONTROL_CORE, update_thread_stack, UPDATE_THREAD_STACK_SIZE,
+        &update_thread_tcb);
+    usb_thread_handle = create_thread(
+        usb_thread, "USB Thread", nullptr, USB_THREAD_PRIORITY, IO_CORE,
+        usb_thread_stack, USB_THREAD_STACK_SIZE, &usb_thread_tcb);
+    com_thread_handle = create_thread(
+        com_thread, "COM Thread", &device_context, COM_THREAD_PRIORITY, IO_CORE,
+        com_thread_stack, COM_THREAD_STACK_SIZE, &com_thread_tcb);
+
+    supervisor_start();
     vTaskStartScheduler();
 }
 
-extern "C" void vApplicationTickHook() {}
+extern "C" void vApplicationTickHook() { supervisor_tick(); }
 
 extern "C" void vApplicationStackOverflowHook(TaskHandle_t Task,
                                               char* pcTaskName)
 {
-    panic("stack overflow (not the helpful kind) for %s\n", *pcTaskName);
+    panic("stack overflow (not the helpful kind) for %s\n", pcTaskName);
+}
+
+// NOTE(patrik): Kernel task memory for configSUPPORT_STATIC_ALLOCATION, the
+// idle tasks of the other cores are allocated by the SMP kernel itself
+static StaticTask_t idle_task_tcb;
+static StackType_t idle_task_stack[configMINIMAL_STACK_SIZE];
+
+extern "C" void vApplicationGetIdleTaskMemory(StaticTask_t** tcb,
+                                              StackType_t** stack,
+                                              uint32_t* stack_size)
+{
+    *tcb = &idle_task_tcb;
+    *stack = idle_task_stack;
+    *stack_size = configMINIMAL_STACK_SIZE;
+}
+
+static StaticTask_t timer_task_tcb;
+static StackType_t timer_task_stack[configTIMER_TASK_STACK_DEPTH];
+
+extern "C" void vApplicationGetTimerTaskMemory(StaticTask_t** tcb,
+                                               StackType_t** stack,
+                                               uint32_t* stack_size)
+{
+    *tcb = &timer_task_tcb;
+    *stack = timer_task_stack;
+    *stack_size = configTIMER_TASK_STACK_DEPTH;
 }
 
 extern "C" void vApplicationMallocFailedHook() { panic("Malloc Failed\n"); }
@@ -0,0 +1,21 @@
+#include "memory.h"
+
+#include <unistd.h>
+
+#include <FreeRTOS.h>
+
+// NOTE(patrik): From the pico SDK linker script, newlib's malloc grows from
+// the end of .bss up to the bottom of the core 0 stack
+extern "C" char __StackLimit;
+
+MemoryStats memory_stats()
+{
+    MemoryStats stats;
+    stats.free_heap = (uint32_t)xPortGetFreeHeapSize();
+    stats.min_free_heap = (uint32_t)xPortGetMinimumEverFreeHeapSize();
+
+    char* brk = (char*)sbrk(0);
+    stats.free_ram = brk < &__StackLimit ? (uint32_t)(&__StackLimit - brk) : 0;
+
+    return stats;
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include "common.h"
+
+struct MemoryStats
+{
+    uint32_t free_heap;     // bytes left in the FreeRTOS heap
+    uint32_t min_free_heap; // lowest free_heap has been since boot
+    uint32_t free_ram;      // bytes between the malloc break and the stack
+};
+
+MemoryStats memory_stats();
@@ -0,0 +1,55 @@
+#include "power.h"
+
+#include <FreeRTOS.h>
+
+#include <hardware/sync.h>
+#include <hardware/timer.h>
+
+// NOTE(patrik): Each core only writes its own slot, so the idle hooks don't
+// need a lock. Readers sum the slots.
+static uint64_t sleep_start[configNUM_CORES];
+static uint64_t sleep_time[configNUM_CORES];
+static uint32_t num_wakeups[configNUM_CORES];
+
+PowerStats power_stats()
+{
+    PowerStats stats = {};
+    stats.uptime = time_us_64();
+    stats.num_cores = configNUM_CORES;
+    for (uint32_t core = 0; core < configNUM_CORES; core++)
+    {
+        stats.sleep_time += sleep_time[core];
+        stats.num_wakeups += num_wakeups[core];
+    }
+
+    return stats;
+}
+
+void power_pre_sleep(uint32_t expected_idle_time)
+{
+    sleep_start[get_core_num()] = time_us_64();
+}
+
+void power_post_sleep(uint32_t expected_idle_time)
+{
+    uint32_t core = get_core_num();
+    sleep_time[core] += time_us_64() - sleep_start[core];
+    num_wakeups[core]++;
+}
+
+void power_idle()
+{
+    // NOTE(patrik): An interrupt that readied a task before the WFI has
+    // already switched away from the idle task (PendSV), one after it wakes
+    // the core up, and the other core pokes this one through the SIO FIFO
+    power_pre_sleep(0);
+    __wfi();
+    power_post_sleep(0);
+}
+
+void vApplicationIdleHook() { power_idle(); }
+
+// NOTE(patrik): The idle tasks on the other core, the hook is called
+// "minimal" in the RP2040 SMP kernel and "passive" from V11 on
+void vApplicationMinimalIdleHook() { power_idle(); }
+void vApplicationPassiveIdleHook() { power_idle(); }
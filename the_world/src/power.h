@@ -0,0 +1,26 @@
+#pragma once
+
+#include "common.h"
+
+struct PowerStats
+{
+    uint64_t uptime;     // us
+    uint64_t sleep_time; // us, summed over the cores
+    uint32_t num_wakeups;
+    uint32_t num_cores;
+};
+
+PowerStats power_stats();
+
+// NOTE(patrik): Called by the kernel around tickless idle sleeps, see
+// configPRE_SLEEP_PROCESSING in FreeRTOSConfig.h
+extern "C" void power_pre_sleep(uint32_t expected_idle_time);
+extern "C" void power_post_sleep(uint32_t expected_idle_time);
+
+// NOTE(patrik): SMP builds have no tickless idle, the idle hooks of both
+// cores sleep with WFI here instead and count it the same way
+void power_idle();
+
+extern "C" void vApplicationIdleHook();
+extern "C" void vApplicationMinimalIdleHook();
+extern "C" void vApplicationPassiveIdleHook();
@@ -0,0 +1,16 @@
+#include "profile.h"
+
+#include "device.h"
+
+static ProfileStat handler_stats[(size_t)ProfileHandler::Count];
+
+ProfileStat* profile_handler(ProfileHandler handler)
+{
+    return &handler_stats[(size_t)handler];
+}
+
+ProfileStat* profile_command(size_t cmd_index)
+{
+    // NOTE(patrik): Sized for the device's commands (see DeviceStorage)
+    return &spec.state.command_stats[cmd_index];
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "common.h"
+
+#include <hardware/timer.h>
+
+// NOTE(patrik): Execution time of the device handlers and commands. Every
+// stat is written by the update thread only so there is no locking, readers
+// can see a stat halfway through an update which is fine for profiling.
+enum class ProfileHandler : uint8_t
+{
+    Update,
+    GetStatus,
+    OnCanMessage,
+
+    Count,
+};
+
+struct ProfileStat
+{
+    uint32_t count;
+    uint32_t min;   // us
+    uint32_t max;   // us
+    uint64_t total; // us
+};
+
+ProfileStat* profile_handler(ProfileHandler handler);
+ProfileStat* profile_command(size_t cmd_index);
+
+inline uint32_t profile_begin() { return time_us_32(); }
+
+inline void profile_end(ProfileStat* stat, uint32_t start)
+{
+    uint32_t time = time_us_32() - start;
+
+    if (stat->count == 0 || time < stat->min)
+        stat->min = time;
+    if (time > stat->max)
+        stat->max = time;
+
+    stat->total += time;
+    stat->count++;
+}
@@ -0,0 +1,786 @@
+#include "settings.h"
+
+#include <string.h>
+#include "can.h"
+#include "device.h"
+#include "supervisor.h"
+#include "util/spsc_queue.h"
+
+#include <FreeRTOS.h>
+#include <task.h>
+
+#include <hardware/flash.h>
+#include <hardware/timer.h>
+#include <pico/flash.h>
+
+// NOTE(patrik): The last sectors of flash, the firmware image has to stay
+// below SETTINGS_OFFSET
+const uint32_t SETTINGS_SIZE = SETTINGS_NUM_SECTORS * FLASH_SECTOR_SIZE;
+const uint32_t SETTINGS_OFFSET = PICO_FLASH_SIZE_BYTES - SETTINGS_SIZE;
+
+// NOTE(patrik): Sector layout
+//  4 bytes - SECTOR_MAGIC, programmed last so a sector only counts once
+//            every live setting made it in
+//  4 bytes - Sequence number, the highest one is the current sector
+//  Records until the first free key
+//
+// Record layout (padded to 4 bytes)
+//  2 bytes - Key
+//  1 byte  - Length of the value, 0 deletes the key
+//  1 byte  - 0xff
+//  N bytes - Value
+//  2 bytes - CRC-16 (CCITT) over everything before it
+const uint32_t SECTOR_MAGIC = 0x53544553;
+const uint32_t NO_SECTOR = 0xffffffff;
+const uint16_t FREE_KEY = 0xffff;
+
+const size_t SECTOR_HEADER_SIZE = 8;
+const size_t RECORD_HEADER_SIZE = 4;
+const size_t RECORD_CRC_SIZE = 2;
+
+const uint32_t FLASH_TIMEOUT_MS = 100;
+
+static constexpr size_t record_size(size_t len)
+{
+    return (RECORD_HEADER_SIZE + len + RECORD_CRC_SIZE + 3) & ~(size_t)3;
+}
+
+const size_t MAX_RECORDS_SIZE = MAX_SETTINGS * record_size(MAX_SETTING_SIZE);
+
+static_assert(SECTOR_HEADER_SIZE + MAX_RECORDS_SIZE <= FLASH_SECTOR_SIZE,
+              "Every setting has to fit in one sector");
+
+struct Setting
+{
+    uint16_t key;
+    uint8_t len;
+    // NOTE(patrik): Changed since the last flush, a dirty setting with
+    // len 0 is a delete that still has to reach flash
+    bool dirty;
+    uint8_t value[MAX_SETTING_SIZE];
+};
+
+// NOTE(patrik): Either a range (min, max) or a list of allowed values when
+// values isn't null
+struct SettingLimit
+{
+    uint16_t key;
+    uint32_t min;
+    uint32_t max;
+    const uint32_t* values;
+    size_t num_values;
+};
+
+static Setting settings[MAX_SETTINGS];
+static size_t num_settings = 0;
+
+static SettingLimit limits[MAX_SETTING_LIMITS];
+static size_t num_limits = 0;
+static size_t num_dirty = 0;
+
+static uint32_t head_sector = NO_SECTOR;
+static uint32_t head_seq = 0;
+static uint32_t head_offset = 0;
+
+static uint64_t first_change = 0;
+static uint64_t last_change = 0;
+
+static SettingsStats stats;
+
+static uint8_t batch[SECTOR_HEADER_SIZE + MAX_RECORDS_SIZE];
+static uint8_t page[FLASH_PAGE_SIZE];
+
+static uint16_t get_u16(const uint8_t* data)
+{
+    return (uint16_t)data[0] | (uint16_t)data[1] << 8;
+}
+
+static uint32_t get_u32(const uint8_t* data)
+{
+    return (uint32_t)get_u16(data) | (uint32_t)get_u16(data + 2) << 16;
+}
+
+static void put_u16(uint8_t* data, uint16_t value)
+{
+    data[0] = value & 0xff;
+    data[1] = value >> 8;
+}
+
+static void put_u32(uint8_t* data, uint32_t value)
+{
+    put_u16(data, value & 0xffff);
+    put_u16(data + 2, value >> 16);
+}
+
+static uint16_t crc16(const uint8_t* data, size_t len)
+{
+    uint16_t crc = 0xffff;
+    for (size_t i = 0; i < len; i++)
+    {
+        crc ^= (uint16_t)data[i] << 8;
+        for (int bit = 0; bit < 8; bit++)
+            crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+
+    return crc;
+}
+
+static const uint8_t* sector_data(uint32_t sector)
+{
+    return (const uint8_t*)(XIP_BASE + SETTINGS_OFFSET +
+                            sector * FLASH_SECTOR_SIZE);
+}
+
+// NOTE(patrik): RAM index
+
+static Setting* find(uint16_t key)
+{
+    for (size_t i = 0; i < num_settings; i++)
+    {
+        if (settings[i].key == key)
+            return &settings[i];
+    }
+
+    return nullptr;
+}
+
+static const SettingLimit* find_limit(uint16_t key)
+{
+    for (size_t i = 0; i < num_limits; i++)
+    {
+        if (limits[i].key == key)
+            return &limits[i];
+    }
+
+    return nullptr;
+}
+
+// NOTE(patrik): Deleting is always fine, the owner goes back to its default
+static bool is_valid(uint16_t key, const uint8_t* value, size_t len)
+{
+    const SettingLimit* limit = find_limit(key);
+    if (!limit || len == 0)
+        return true;
+    if (len != 4)
+        return false;
+
+    uint32_t v = get_u32(value);
+    if (!limit->values)
+        return v >= limit->min && v <= limit->max;
+
+    for (size_t i = 0; i < limit->num_values; i++)
+    {
+        if (limit->values[i] == v)
+            return true;
+    }
+
+    return false;
+}
+
+static bool add_limit(const SettingLimit& limit)
+{
+    if (find_limit(limit.key) || num_limits >= MAX_SETTING_LIMITS)
+        return false;
+
+    limits[num_limits++] = limit;
+    return true;
+}
+
+static void remove(Setting* setting)
+{
+    *setting = settings[--num_settings];
+}
+
+static void remove_deleted()
+{
+    for (size_t i = 0; i < num_settings;)
+    {
+        if (settings[i].len == 0 && !settings[i].dirty)
+            remove(&settings[i]);
+        else
+            i++;
+    }
+}
+
+// NOTE(patrik): Log scan
+
+static void apply_record(uint16_t key, const uint8_t* value, size_t len)
+{
+    Setting* setting = find(key);
+    if (len == 0)
+    {
+        if (setting)
+            remove(setting);
+        return;
+    }
+
+    if (!setting)
+    {
+        if (num_settings >= MAX_SETTINGS)
+            return;
+
+        setting = &settings[num_settings++];
+        setting->key = key;
+    }
+
+    setting->len = (uint8_t)len;
+    setting->dirty = false;
+    memcpy(setting->value, value, len);
+}
+
+// NOTE(patrik): Returns where the next record goes, a bad record ends the
+// scan and leaves the sector full so the next flush moves on to a fresh one
+static uint32_t scan_sector(uint32_t sector)
+{
+    const uint8_t* data = sector_data(sector);
+
+    uint32_t offset = SECTOR_HEADER_SIZE;
+    while (offset + RECORD_HEADER_SIZE <= FLASH_SECTOR_SIZE)
+    {
+        const uint8_t* record = data + offset;
+
+        uint16_t key = get_u16(record);
+        if (key == FREE_KEY)
+            break;
+
+        uint8_t len = record[2];
+        size_t size = record_size(len);
+        if (len > MAX_SETTING_SIZE || offset + size > FLASH_SECTOR_SIZE ||
+            crc16(record, RECORD_HEADER_SIZE + len) !=
+                get_u16(record + RECORD_HEADER_SIZE + len))
+        {
+            stats.num_bad_records++;
+            return FLASH_SECTOR_SIZE;
+        }
+
+        apply_record(key, record + RECORD_HEADER_SIZE, len);
+        offset += size;
+    }
+
+    return offset;
+}
+
+void settings_init()
+{
+    num_settings = 0;
+    num_dirty = 0;
+    head_sector = NO_SECTOR;
+
+    // NOTE(patrik): Every complete sector starts with every live setting,
+    // only the newest one needs to be read
+    for (uint32_t sector = 0; sector < SETTINGS_NUM_SECTORS; sector++)
+    {
+        const uint8_t* data = sector_data(sector);
+        if (get_u32(data) != SECTOR_MAGIC)
+            continue;
+
+        uint32_t seq = get_u32(data + 4);
+        if (head_sector == NO_SECTOR || seq > head_seq)
+        {
+            head_sector = sector;
+            head_seq = seq;
+        }
+    }
+
+    if (head_sector != NO_SECTOR)
+        head_offset = scan_sector(head_sector);
+}
+
+// NOTE(patrik): Flash writes, every operation stops both cores with
+// interrupts off (flash_safe_execute), programs go a page at a time so
+// interrupts get to run in between
+
+struct FlashOp
+{
+    uint32_t offset;
+    const uint8_t* data;
+};
+
+static void erase_op(void* param)
+{
+    FlashOp* op = (FlashOp*)param;
+    flash_range_erase(op->offset, FLASH_SECTOR_SIZE);
+}
+
+static void program_op(void* param)
+{
+    FlashOp* op = (FlashOp*)param;
+    flash_range_program(op->offset, op->data, FLASH_PAGE_SIZE);
+}
+
+static bool run_flash_op(void (*func)(void*), FlashOp* op)
+{
+    uint64_t start = time_us_64();
+    int result = flash_safe_execute(func, op, FLASH_TIMEOUT_MS);
+
+    uint32_t stall = (uint32_t)(time_us_64() - start);
+    if (stall > stats.last_stall)
+        stats.last_stall = stall;
+    if (stall > stats.max_stall)
+        stats.max_stall = stall;
+
+    return result == PICO_OK;
+}
+
+static bool erase_sector(uint32_t sector)
+{
+    FlashOp op;
+    op.offset = SETTINGS_OFFSET + sector * FLASH_SECTOR_SIZE;
+    op.data = nullptr;
+
+    stats.num_erases++;
+    return run_flash_op(erase_op, &op);
+}
+
+// NOTE(patrik): Bytes of the page outside data are left at 0xff, which
+// doesn't change what's already programmed there
+static bool program(uint32_t sector, uint32_t offset, const uint8_t* data,
+                    size_t len)
+{
+    uint32_t base = SETTINGS_OFFSET + sector * FLASH_SECTOR_SIZE;
+
+    while (len > 0)
+    {
+        uint32_t page_offset = offset & ~(FLASH_PAGE_SIZE - 1);
+        uint32_t start = offset - page_offset;
+        size_t count = FLASH_PAGE_SIZE - start;
+        if (count > len)
+            count = len;
+
+        memset(page, 0xff, sizeof(page));
+        memcpy(page + start, data, count);
+
+        FlashOp op;
+        op.offset = base + page_offset;
+        op.data = page;
+        if (!run_flash_op(program_op, &op))
+            return false;
+
+        offset += count;
+        data += count;
+        len -= count;
+    }
+
+    return true;
+}
+
+static size_t put_record(uint8_t* data, const Setting& setting)
+{
+    size_t size = record_size(setting.len);
+    memset(data, 0xff, size);
+
+    put_u16(data, setting.key);
+    data[2] = setting.len;
+    memcpy(data + RECORD_HEADER_SIZE, setting.value, setting.len);
+
+    uint16_t crc = crc16(data, RECORD_HEADER_SIZE + setting.len);
+    put_u16(data + RECORD_HEADER_SIZE + setting.len, crc);
+
+    return size;
+}
+
+// NOTE(patrik): Moves on to the next sector with a copy of every live
+// setting, the header goes in last
+static bool start_sector()
+{
+    uint32_t sector = 0;
+    if (head_sector != NO_SECTOR)
+        sector = (head_sector + 1) % SETTINGS_NUM_SECTORS;
+
+    size_t len = 0;
+    for (size_t i = 0; i < num_settings; i++)
+    {
+        if (settings[i].len > 0)
+            len += put_record(batch + len, settings[i]);
+    }
+
+    if (!erase_sector(sector))
+        return false;
+    if (!program(sector, SECTOR_HEADER_SIZE, batch, len))
+        return false;
+
+    uint8_t header[SECTOR_HEADER_SIZE];
+    put_u32(header, SECTOR_MAGIC);
+    put_u32(header + 4, head_seq + 1);
+    if (!program(sector, 0, header, sizeof(header)))
+        return false;
+
+    head_sector = sector;
+    head_seq++;
+    head_offset = SECTOR_HEADER_SIZE + len;
+
+    return true;
+}
+
+static bool flush()
+{
+    stats.last_stall = 0;
+
+    size_t len = 0;
+    for (size_t i = 0; i < num_settings; i++)
+    {
+        if (settings[i].dirty)
+            len += put_record(batch + len, settings[i]);
+    }
+
+    bool ok = false;
+    if (head_sector != NO_SECTOR && head_offset + len <= FLASH_SECTOR_SIZE)
+    {
+        ok = program(head_sector, head_offset, batch, len);
+        if (ok)
+            head_offset += len;
+        else
+            head_offset = FLASH_SECTOR_SIZE;
+    }
+    else
+    {
+        ok = start_sector();
+    }
+
+    if (!ok)
+        return false;
+
+    for (size_t i = 0; i < num_settings; i++)
+        settings[i].dirty = false;
+    num_dirty = 0;
+    remove_deleted();
+
+    stats.num_flushes++;
+    return true;
+}
+
+// NOTE(patrik): Update thread
+
+size_t settings_get(uint16_t key, uint8_t* value, size_t max_len)
+{
+    Setting* setting = find(key);
+    if (!setting)
+        return 0;
+
+    memcpy(value, setting->value,
+           setting->len < max_len ? setting->len : max_len);
+    return setting->len;
+}
+
+uint32_t settings_get_u32(uint16_t key, uint32_t fallback)
+{
+    uint8_t value[4];
+    if (settings_get(key, value, sizeof(value)) != sizeof(value))
+        return fallback;
+    if (!is_valid(key, value, sizeof(value)))
+        return fallback;
+
+    return get_u32(value);
+}
+
+bool settings_set(uint16_t key, const uint8_t* value, size_t len)
+{
+    if (key == FREE_KEY || len > MAX_SETTING_SIZE)
+        return false;
+    if (!is_valid(key, value, len))
+        return false;
+
+    Setting* setting = find(key);
+    if (!setting)
+    {
+        if (len == 0)
+            return true;
+        if (num_settings >= MAX_SETTINGS)
+            return false;
+
+        setting = &settings[num_settings++];
+        setting->key = key;
+        setting->len = 0;
+        setting->dirty = false;
+    }
+    else if (setting->len == len &&
+             (len == 0 || memcmp(setting->value, value, len) == 0))
+    {
+        return true;
+    }
+
+    setting->len = (uint8_t)len;
+    if (len > 0)
+        memcpy(setting->value, value, len);
+
+    uint64_t now = time_us_64();
+    if (num_dirty == 0)
+        first_change = now;
+    last_change = now;
+
+    if (!setting->dirty)
+    {
+        setting->dirty = true;
+        num_dirty++;
+    }
+
+    return true;
+}
+
+bool settings_set_u32(uint16_t key, uint32_t value)
+{
+    uint8_t data[4];
+    put_u32(data, value);
+
+    return settings_set(key, data, sizeof(data));
+}
+
+bool settings_limit_u32(uint16_t key, uint32_t min, uint32_t max)
+{
+    return add_limit(SettingLimit{key, min, max, nullptr, 0});
+}
+
+bool settings_allow_u32(uint16_t key, const uint32_t* values,
+                        size_t num_values)
+{
+    return add_limit(SettingLimit{key, 0, 0, values, num_values});
+}
+
+uint64_t settings_update(uint64_t now)
+{
+    if (num_dirty == 0)
+        return NO_DEADLINE;
+
+    // NOTE(patrik): Changes keep coming in bursts (a host setting a few
+    // values), wait for them to stop but don't hold on to them forever
+    uint64_t latest = first_change + SETTINGS_MAX_DEFER_MS * 1000;
+    uint64_t due = last_change + SETTINGS_FLUSH_DELAY_MS * 1000;
+    if (due > latest)
+        due = latest;
+    if (now < due)
+        return due;
+
+    // NOTE(patrik): Interrupts are off during an erase, the MCP2515 only
+    // buffers two frames
+    uint64_t quiet = can_last_frame_time() + SETTINGS_CAN_QUIET_MS * 1000;
+    if (now < quiet && now < latest)
+        return quiet < latest ? quiet : latest;
+
+    if (!flush())
+    {
+        first_change = now;
+        last_change = now;
+        return now + SETTINGS_FLUSH_DELAY_MS * 1000;
+    }
+
+    return NO_DEADLINE;
+}
+
+SettingsStats settings_stats()
+{
+    stats.num_settings = 0;
+    for (size_t i = 0; i < num_settings; i++)
+    {
+        if (settings[i].len > 0)
+            stats.num_settings++;
+    }
+
+    stats.num_dirty = num_dirty;
+    stats.sector_seq = head_seq;
+    stats.sector_used = head_sector != NO_SECTOR ? head_offset : 0;
+
+    return stats;
+}
+
+// NOTE(patrik): Requests from the COM task, same handoff as the commands
+// (see command.cpp)
+
+enum class SettingsCommand : uint8_t
+{
+    List,
+    Get,
+    Set,
+    Flush,
+    Stats,
+};
+
+struct SettingsRequest
+{
+    uint8_t data[1 + 2 + MAX_SETTING_SIZE];
+    uint8_t len;
+    TaskHandle_t reply_to;
+};
+
+struct SettingsResponse
+{
+    ResponseErrorCode error_code;
+    uint8_t len;
+    uint8_t data[SETTINGS_RESPONSE_SIZE];
+
+    void push_u8(uint8_t value)
+    {
+        if (len < sizeof(data))
+            data[len++] = value;
+    }
+
+    void push_u32(uint32_t value)
+    {
+        for (int i = 0; i < 4; i++)
+            push_u8((value >> (i * 8)) & 0xff);
+    }
+};
+
+static SpscQueue<SettingsRequest, 2> requests;
+static SpscQueue<SettingsResponse, 2> responses;
+
+static void push_stats(SettingsResponse* response)
+{
+    SettingsStats stats = settings_stats();
+
+    response->push_u32(stats.num_settings);
+    response->push_u32(stats.num_dirty);
+    response->push_u32(stats.sector_seq);
+    response->push_u32(stats.sector_used);
+    response->push_u32(stats.num_flushes);
+    response->push_u32(stats.num_erases);
+    response->push_u32(stats.num_bad_records);
+    response->push_u32(stats.last_stall);
+    response->push_u32(stats.max_stall);
+}
+
+static void push_setting(SettingsResponse* response, const Setting& setting)
+{
+    response->push_u8(setting.key & 0xff);
+    response->push_u8(setting.key >> 8);
+    response->push_u8(setting.len);
+    for (size_t i = 0; i < setting.len; i++)
+        response->push_u8(setting.value[i]);
+}
+
+// NOTE(patrik): Settings from start on, as many as fit, the host asks again
+// for the rest
+static void push_settings(SettingsResponse* response, size_t start)
+{
+    response->push_u8((uint8_t)settings_stats().num_settings);
+
+    size_t index = 0;
+    for (size_t i = 0; i < num_settings; i++)
+    {
+        const Setting& setting = settings[i];
+        if (setting.len == 0)
+            continue;
+
+        if (index++ < start)
+            continue;
+
+        if (response->len + 3 + setting.len > sizeof(response->data))
+            break;
+
+        push_setting(response, setting);
+    }
+}
+
+static void handle_request(const SettingsRequest& request,
+                           SettingsResponse* response)
+{
+    response->error_code = ResponseErrorCode::Success;
+    response->len = 0;
+
+    const uint8_t* data = request.data;
+    SettingsCommand command = (SettingsCommand)data[0];
+
+    bool needs_key =
+        command == SettingsCommand::Get || command == SettingsCommand::Set;
+    if (needs_key && request.len < 3)
+    {
+        response->error_code =
+            ResponseErrorCode::InsufficientFunctionParameters;
+        return;
+    }
+
+    uint16_t key = needs_key ? get_u16(data + 1) : FREE_KEY;
+    Setting* setting = nullptr;
+
+    switch (command)
+    {
+        case SettingsCommand::List:
+            push_settings(response, request.len >= 2 ? data[1] : 0);
+            break;
+
+        case SettingsCommand::Get:
+            setting = find(key);
+            response->push_u8(setting ? setting->len : 0);
+            for (size_t i = 0; setting && i < setting->len; i++)
+                response->push_u8(setting->value[i]);
+            break;
+
+        case SettingsCommand::Set:
+            if (!settings_set(key, data + 3, request.len - 3))
+                response->error_code = ResponseErrorCode::InvalidFunction;
+            break;
+
+        case SettingsCommand::Flush:
+            // NOTE(patrik): Asked for by the host, doesn't wait for the
+            // delays
+            if (num_dirty > 0 && !flush())
+            {
+                response->error_code = ResponseErrorCode::InvalidDevice;
+                break;
+            }
+
+            push_stats(response);
+            break;
+
+        case SettingsCommand::Stats: push_stats(response); break;
+
+        default: response->error_code = ResponseErrorCode::InvalidFunction;
+    }
+}
+
+// NOTE(patrik): A response is ~250 bytes, too much for the task stacks. Each
+// side only ever has one request in hand so they live here, the update thread
+// owns the first pair and COM the second.
+static SettingsRequest process_request;
+static SettingsResponse process_response;
+static SettingsRequest submit_request;
+static SettingsResponse submit_response;
+
+void settings_process()
+{
+    SettingsRequest& request = process_request;
+    while (requests.pop(&request))
+    {
+        SettingsResponse& response = process_response;
+        handle_request(request, &response);
+
+        // NOTE(patrik): The COM task only has one request in flight
+        responses.push(response);
+        xTaskNotifyGive(request.reply_to);
+    }
+}
+
+ResponseErrorCode settings_request(const uint8_t* data, size_t len,
+                                   uint8_t* response_data,
+                                   size_t* response_len)
+{
+    *response_len = 0;
+
+    SettingsRequest& request = submit_request;
+    if (len == 0)
+        return ResponseErrorCode::InsufficientFunctionParameters;
+    if (len > sizeof(request.data))
+        return ResponseErrorCode::InvalidFunction;
+
+    memcpy(request.data, data, len);
+    request.len = (uint8_t)len;
+    request.reply_to = xTaskGetCurrentTaskHandle();
+
+    if (!requests.push(request))
+        return ResponseErrorCode::InvalidDevice;
+
+    device_wake();
+
+    SettingsResponse& response = submit_response;
+    while (!responses.pop(&response))
+    {
+        // NOTE(patrik): Same as command_wait_result, a flush can stall the
+        // update thread for a while
+        supervisor_checkin(SupervisedTask::Com);
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(SUPERVISOR_CHECKIN_MS));
+    }
+
+    memcpy(response_data, response.data, response.len);
+    *response_len = response.len;
+
+    return response.error_code;
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "common.h"
+
+// NOTE(patrik): Key-value settings kept in a log at the end of flash, so
+// tunables can change without a rebuild. Every record carries a CRC and the
+// newest record for a key wins, a record with no value deletes the key.
+//
+// The log rotates through SETTINGS_NUM_SECTORS sectors for wear leveling.
+// When the current sector is full the next one is erased and starts with
+// every live setting, so only the newest sector has to be complete and a
+// sector is never erased before a newer copy of its data exists.
+//
+// settings_init scans the log once at boot into a RAM index, reads never
+// touch flash after that. Writes only change the index, the update thread
+// flushes them in one batch SETTINGS_FLUSH_DELAY_MS after the last change,
+// after the CAN handler and the control outputs for that pass and while the
+// bus is quiet, never from the COM task.
+const size_t MAX_SETTINGS = 32;
+const size_t MAX_SETTING_SIZE = 16;
+
+const uint32_t SETTINGS_NUM_SECTORS = 4;
+
+const uint32_t SETTINGS_FLUSH_DELAY_MS = 1000;
+// NOTE(patrik): A flush waits for a gap in the CAN traffic, but no longer
+// than SETTINGS_MAX_DEFER_MS after the first unsaved change
+const uint32_t SETTINGS_CAN_QUIET_MS = 20;
+const uint32_t SETTINGS_MAX_DEFER_MS = 10 * 1000;
+
+// NOTE(patrik): Keys below SETTING_DEVICE are the runtime's, devices number
+// theirs from SETTING_DEVICE. 0xffff marks free space in the log.
+enum SettingKey : uint16_t
+{
+    SETTING_CAN_BITRATE = 0x0001, // kbps
+
+    SETTING_DEVICE = 0x0100,
+};
+
+struct SettingsStats
+{
+    uint32_t num_settings;
+    uint32_t num_dirty;
+    uint32_t sector_seq;
+    uint32_t sector_used; // bytes
+    uint32_t num_flushes;
+    uint32_t num_erases;
+    uint32_t num_bad_records;
+    uint32_t last_stall; // us, longest flash operation of the last flush
+    uint32_t max_stall;  // us
+};
+
+// NOTE(patrik): Runs before the devices and CAN are set up so they can use
+// their settings in init
+void settings_init();
+
+// NOTE(patrik): Update thread only (and init before the scheduler starts).
+// settings_get returns the length of the value, 0 when the key isn't set.
+size_t settings_get(uint16_t key, uint8_t* value, size_t max_len);
+uint32_t settings_get_u32(uint16_t key, uint32_t fallback);
+bool settings_set(uint16_t key, const uint8_t* value, size_t len);
+bool settings_set_u32(uint16_t key, uint32_t value);
+
+// NOTE(patrik): Valid range of a u32 setting, registered by its owner in init.
+// settings_set rejects anything else for the key (the host gets an error) and
+// settings_get_u32 hands back the fallback for a stored value outside of it,
+// so a value written before the limit existed can't get through either.
+//
+// settings_allow_u32 does the same for a setting that only takes a few
+// values, values isn't copied and has to outlive the program (a static
+// table). A key gets either a range or a list, not both.
+const size_t MAX_SETTING_LIMITS = 16;
+
+bool settings_limit_u32(uint16_t key, uint32_t min, uint32_t max);
+bool settings_allow_u32(uint16_t key, const uint32_t* values,
+                        size_t num_values);
+
+// NOTE(patrik): Flushes when it's time, returns when it needs to run again
+uint64_t settings_update(uint64_t now);
+// NOTE(patrik): Answers the requests from settings_request
+void settings_process();
+
+SettingsStats settings_stats();
+
+// NOTE(patrik): COM task, hands a SETTINGS packet (see docs/protocol.md) to
+// the update thread and waits for the answer. response needs
+// SETTINGS_RESPONSE_SIZE bytes.
+const size_t SETTINGS_RESPONSE_SIZE = 240;
+
+ResponseErrorCode settings_request(const uint8_t* request, size_t len,
+                                   uint8_t* response, size_t* response_len);
@@ -0,0 +1,44 @@
+#include "status.h"
+
+#include <string.h>
+#include "device.h"
+#include "profile.h"
+#include "trace.h"
+#include "util/seqlock.h"
+
+struct StatusBuffer
+{
+    uint8_t data[STATUS_BUFFER_SIZE];
+};
+
+static Seqlock<StatusBuffer> snapshot;
+
+// NOTE(patrik): Only touched by the update thread
+static StatusBuffer last;
+
+void status_publish()
+{
+    StatusBuffer status;
+    memset(&status, 0, sizeof(status));
+
+    uint32_t start = profile_begin();
+    spec.get_status(status.data);
+    profile_end(profile_handler(ProfileHandler::GetStatus), start);
+    trace_span(TRACE_HANDLER_BEGIN, (uint16_t)ProfileHandler::GetStatus,
+               start);
+
+    if (memcmp(&status, &last, sizeof(status)) == 0)
+        return;
+
+    last = status;
+    snapshot.write(status);
+}
+
+uint32_t status_read(uint8_t* buffer)
+{
+    StatusBuffer status;
+    uint32_t version = snapshot.read(&status);
+
+    memcpy(buffer, status.data, sizeof(status.data));
+    return version;
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include "common.h"
+
+// NOTE(patrik): The device status as the COM task sees it. The update
+// thread runs spec.get_status once per pass, after the CAN handler and the
+// device update, and publishes the buffer when it changed. Readers get a
+// consistent copy without locking or blocking the update thread (see
+// util/seqlock.h).
+void status_publish();
+
+// NOTE(patrik): buffer needs STATUS_BUFFER_SIZE bytes, returns the number
+// of times the status has changed, which stays the same until it changes
+// again
+uint32_t status_read(uint8_t* buffer);
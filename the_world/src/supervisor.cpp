@@ -0,0 +1,146 @@
+#include "supervisor.h"
+
+#include <atomic>
+
+#include <hardware/timer.h>
+#include <hardware/watchdog.h>
+
+// NOTE(patrik): The pico SDK uses scratch 4-7 for watchdog_reboot, we get
+// 0-3
+//  0 - RETAIN_MAGIC when the rest is valid
+//  1 - Control outputs, one bit per GPIO
+//  2 - Inverse of 1, a reset between the two writes makes the outputs
+//      invalid instead of half restored
+//  3 - Warm restarts (bits 0-15), last stalled task (bits 16-23)
+const uint32_t RETAIN_MAGIC = 0x7468776f;
+
+const uint32_t SCRATCH_MAGIC = 0;
+const uint32_t SCRATCH_CONTROLS = 1;
+const uint32_t SCRATCH_CONTROLS_INV = 2;
+const uint32_t SCRATCH_COUNTERS = 3;
+
+struct TaskState
+{
+    // NOTE(patrik): 0 when the task hasn't registered
+    std::atomic<uint32_t> deadline{0};
+    std::atomic<uint32_t> last_checkin{0};
+};
+
+static TaskState tasks[(size_t)SupervisedTask::Count];
+
+static SupervisorStats stats;
+static bool controls_valid = false;
+static uint32_t retained_controls = 0;
+static bool stalled = false;
+static bool started = false;
+
+static uint32_t pack_counters(uint16_t num_warm_restarts, uint8_t stalled_task)
+{
+    return (uint32_t)num_warm_restarts | (uint32_t)stalled_task << 16;
+}
+
+void supervisor_init()
+{
+    io_rw_32* scratch = watchdog_hw->scratch;
+
+    // NOTE(patrik): Only a reset from our own watchdog counts as warm,
+    // power on, the reset button and watchdog_reboot all start cold
+    bool retained = watchdog_enable_caused_reboot() &&
+                    scratch[SCRATCH_MAGIC] == RETAIN_MAGIC;
+
+    stats.warm_restart = retained;
+    stats.num_warm_restarts = 0;
+    stats.last_stalled_task = NO_STALLED_TASK;
+
+    if (retained)
+    {
+        uint32_t counters = scratch[SCRATCH_COUNTERS];
+        stats.num_warm_restarts = (uint16_t)(counters & 0xffff) + 1;
+        stats.last_stalled_task = (uint8_t)(counters >> 16);
+
+        uint32_t controls = scratch[SCRATCH_CONTROLS];
+        controls_valid = controls == ~scratch[SCRATCH_CONTROLS_INV];
+        if (controls_valid)
+            retained_controls = controls;
+    }
+
+    scratch[SCRATCH_CONTROLS] = retained_controls;
+    scratch[SCRATCH_CONTROLS_INV] = ~retained_controls;
+    scratch[SCRATCH_COUNTERS] =
+        pack_counters(stats.num_warm_restarts, NO_STALLED_TASK);
+    scratch[SCRATCH_MAGIC] = RETAIN_MAGIC;
+}
+
+void supervisor_start()
+{
+    // NOTE(patrik): Paused while a debugger holds the cores
+    watchdog_enable(WATCHDOG_TIMEOUT_MS, true);
+    started = true;
+}
+
+void supervisor_tick()
+{
+    if (!started || stalled)
+        return;
+
+    uint32_t now = time_us_32();
+    for (size_t i = 0; i < (size_t)SupervisedTask::Count; i++)
+    {
+        uint32_t deadline = tasks[i].deadline.load(std::memory_order_relaxed);
+        if (deadline == 0)
+            continue;
+
+        uint32_t last = tasks[i].last_checkin.load(std::memory_order_relaxed);
+        if (now - last > deadline)
+        {
+            // NOTE(patrik): Stop feeding for good, the watchdog resets us
+            // within WATCHDOG_TIMEOUT_MS
+            stalled = true;
+            watchdog_hw->scratch[SCRATCH_COUNTERS] =
+                pack_counters(stats.num_warm_restarts, (uint8_t)i);
+            return;
+        }
+    }
+
+    watchdog_update();
+}
+
+void supervisor_register(SupervisedTask task, uint32_t deadline_ms)
+{
+    TaskState* state = &tasks[(size_t)task];
+    state->last_checkin.store(time_us_32(), std::memory_order_relaxed);
+    state->deadline.store(deadline_ms * 1000, std::memory_order_relaxed);
+}
+
+void supervisor_checkin(SupervisedTask task)
+{
+    tasks[(size_t)task].last_checkin.store(time_us_32(),
+                                           std::memory_order_relaxed);
+}
+
+uint32_t supervisor_checkin_age(SupervisedTask task)
+{
+    TaskState* state = &tasks[(size_t)task];
+    if (state->deadline.load(std::memory_order_relaxed) == 0)
+        return 0;
+
+    return time_us_32() - state->last_checkin.load(std::memory_order_relaxed);
+}
+
+SupervisorStats supervisor_stats() { return stats; }
+
+bool supervisor_retained_control(uint32_t pin)
+{
+    return controls_valid && (retained_controls & (1u << pin)) != 0;
+}
+
+void supervisor_retain_control(uint32_t pin, bool on)
+{
+    if (on)
+        retained_controls |= 1u << pin;
+    else
+        retained_controls &= ~(1u << pin);
+
+    watchdog_hw->scratch[SCRATCH_CONTROLS] = retained_controls;
+    watchdog_hw->scratch[SCRATCH_CONTROLS_INV] = ~retained_controls;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "common.h"
+
+// NOTE(patrik): Hardware watchdog fed from the tick hook, but only while
+// every registered task has checked in within its deadline. A task that
+// blocks has to wake up at least every SUPERVISOR_CHECKIN_MS to check in,
+// waiting on input is fine, spinning or deadlocking is not.
+//
+// The watchdog scratch registers keep the control outputs and a few
+// counters over a watchdog reset, PhysicalControl::init restores the
+// outputs from them so a warm restart doesn't drop the relays.
+const uint32_t SUPERVISOR_CHECKIN_MS = 250;
+// NOTE(patrik): Default deadline, room for a slow device update or command on
+// top of the check in interval
+const uint32_t SUPERVISOR_DEADLINE_MS = 4 * SUPERVISOR_CHECKIN_MS;
+const uint32_t WATCHDOG_TIMEOUT_MS = 500;
+
+enum class SupervisedTask : uint8_t
+{
+    Update,
+    Usb,
+    Com,
+
+    Count,
+};
+
+const uint8_t NO_STALLED_TASK = 0xff;
+
+struct SupervisorStats
+{
+    bool warm_restart;
+    uint16_t num_warm_restarts;
+    // NOTE(patrik): Task that missed its deadline before the last reset
+    uint8_t last_stalled_task;
+};
+
+// NOTE(patrik): Reads back the retained state, has to run before the
+// controls are initialized
+void supervisor_init();
+// NOTE(patrik): Arms the watchdog, called right before the scheduler starts
+void supervisor_start();
+// NOTE(patrik): From vApplicationTickHook
+void supervisor_tick();
+
+// NOTE(patrik): Called by the task itself, the deadline starts counting from
+// here
+void supervisor_register(SupervisedTask task, uint32_t deadline_ms);
+void supervisor_checkin(SupervisedTask task);
+// NOTE(patrik): Time since the task last checked in (us), 0 if the task
+// isn't registered
+uint32_t supervisor_checkin_age(SupervisedTask task);
+
+SupervisorStats supervisor_stats();
+
+// NOTE(patrik): Retained control outputs, one bit per GPIO
+bool supervisor_retained_control(uint32_t pin);
+void supervisor_retain_control(uint32_t pin, bool on);
@@ -0,0 +1,68 @@
+#include "trace.h"
+
+#include <hardware/sync.h>
+#include <hardware/timer.h>
+
+static TraceEvent events[TRACE_NUM_CORES][TRACE_BUFFER_SIZE];
+static uint32_t heads[TRACE_NUM_CORES];
+static volatile bool is_frozen = false;
+
+static_assert((TRACE_BUFFER_SIZE & (TRACE_BUFFER_SIZE - 1)) == 0,
+              "TRACE_BUFFER_SIZE must be a power of two");
+
+void trace_event_at(uint32_t time, uint8_t type, uint16_t arg)
+{
+    if (is_frozen)
+        return;
+
+    // NOTE(patrik): Each core has its own ring, so only the interrupts on
+    // this core can get in the way
+    uint32_t save = save_and_disable_interrupts();
+
+    uint32_t core = get_core_num();
+    uint32_t head = heads[core];
+
+    TraceEvent* event = &events[core][head & (TRACE_BUFFER_SIZE - 1)];
+    event->time = time;
+    event->type = type;
+    event->reserved = 0;
+    event->arg = arg;
+
+    heads[core] = head + 1;
+
+    restore_interrupts(save);
+}
+
+void trace_event(uint8_t type, uint16_t arg)
+{
+    trace_event_at(time_us_32(), type, arg);
+}
+
+void trace_span(uint8_t begin_type, uint16_t arg, uint32_t start)
+{
+    uint32_t now = time_us_32();
+    trace_event_at(start, begin_type, arg);
+    trace_event_at(now, begin_type + 1, arg);
+}
+
+void trace_freeze(bool frozen) { is_frozen = frozen; }
+
+void trace_clear()
+{
+    for (uint32_t core = 0; core < TRACE_NUM_CORES; core++)
+        heads[core] = 0;
+}
+
+uint32_t trace_count(uint32_t core)
+{
+    uint32_t head = heads[core];
+    return head < TRACE_BUFFER_SIZE ? head : TRACE_BUFFER_SIZE;
+}
+
+TraceEvent trace_get(uint32_t core, uint32_t index)
+{
+    uint32_t head = heads[core];
+    uint32_t first = head - trace_count(core);
+
+    return events[core][(first + index) & (TRACE_BUFFER_SIZE - 1)];
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// NOTE(patrik): RAM trace recorder. Compact 8 byte events go into a ring per
+// core, old events get overwritten. It's hooked into the kernel from
+// FreeRTOSConfig.h so this header has to stay plain C.
+//
+// The buffer is dumped with the Trace packet (see docs/protocol.md) and
+// `dio trace` turns it into a Perfetto (Chrome JSON) trace.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TRACE_BUFFER_SIZE 1024
+#define TRACE_NUM_CORES 2
+
+// NOTE(patrik): The arg of each event. Every *_END has to come right after
+// its *_BEGIN, trace_span depends on it.
+enum TraceEventType
+{
+    TRACE_TASK_SWITCHED_IN = 1, // TCB number
+    TRACE_NOTIFY,               // TCB number of the notified task
+    TRACE_NOTIFY_FROM_ISR,      // TCB number of the notified task
+    TRACE_GPIO_IRQ,             // pin | events << 8
+    TRACE_CAN_IRQ,              // 0
+    TRACE_HANDLER_BEGIN,        // ProfileHandler
+    TRACE_HANDLER_END,          // ProfileHandler
+    TRACE_COMMAND_BEGIN,        // Command index
+    TRACE_COMMAND_END,          // Command index
+    TRACE_PACKET_BEGIN,         // Packet type
+    TRACE_PACKET_END,           // Packet type
+    TRACE_CONTROL_SET,          // pin | on << 8
+};
+
+typedef struct
+{
+    uint32_t time; // us, wraps
+    uint8_t type;
+    uint8_t reserved;
+    uint16_t arg;
+} TraceEvent;
+
+void trace_event_at(uint32_t time, uint8_t type, uint16_t arg);
+void trace_event(uint8_t type, uint16_t arg);
+
+// NOTE(patrik): Begin/end pair for something that started at start, written
+// once it is done so the begin event lands in the buffer late
+void trace_span(uint8_t begin_type, uint16_t arg, uint32_t start);
+
+// NOTE(patrik): Reader side, used by the Trace packet. Recording stops
+// while frozen so the buffer can be read out in pieces.
+void trace_freeze(bool frozen);
+void trace_clear();
+uint32_t trace_count(uint32_t core);
+TraceEvent trace_get(uint32_t core, uint32_t index); // 0 is the oldest
+
+#ifdef __cplusplus
+}
+#endif
@@ -41,9 +41,11 @@
 
 #define CFG_TUSB_RHPORT0_MODE     OPT_MODE_DEVICE
 
-#ifndef CFG_TUSB_OS
-#define CFG_TUSB_OS                 OPT_OS_PICO
-#endif
+// NOTE(patrik): The pico SDK passes CFG_TUSB_OS=OPT_OS_PICO on the command
+// line, override it so tud_task() blocks on a FreeRTOS queue until the USB
+// interrupt posts an event instead of being polled
+#undef CFG_TUSB_OS
+#define CFG_TUSB_OS                 OPT_OS_FREERTOS
 
 #ifndef CFG_TUSB_MEM_SECTION
 #define CFG_TUSB_MEM_SECTION
@@ -66,11 +68,19 @@
 #define CFG_TUD_CDC             2
 #define CFG_TUD_MSC             0
 #define CFG_TUD_MIDI            0
+
+// Vendor bulk transport for the command channel, enabled from CMake
+// (USB_VENDOR_TRANSPORT)
+#ifndef CFG_TUD_VENDOR
 #define CFG_TUD_VENDOR          0
+#endif
 
 #define CFG_TUD_CDC_RX_BUFSIZE 64
 #define CFG_TUD_CDC_TX_BUFSIZE 64
 
+#define CFG_TUD_VENDOR_RX_BUFSIZE 512
+#define CFG_TUD_VENDOR_TX_BUFSIZE 512
+
 #ifndef TUD_OPT_RP2040_USB_DEVICE_UFRAME_FIX
 #define TUD_OPT_RP2040_USB_DEVICE_UFRAME_FIX 1
 #endif
@@ -84,10 +84,15 @@ enum
     ITF_NUM_CDC_0_DATA,
     ITF_NUM_CDC_1,
     ITF_NUM_CDC_1_DATA,
+#if CFG_TUD_VENDOR
+    ITF_NUM_VENDOR,
+#endif
     ITF_NUM_TOTAL
 };
 
-#define CONFIG_TOTAL_LEN (TUD_CONFIG_DESC_LEN + CFG_TUD_CDC * TUD_CDC_DESC_LEN)
+#define CONFIG_TOTAL_LEN                                                       \
+    (TUD_CONFIG_DESC_LEN + CFG_TUD_CDC * TUD_CDC_DESC_LEN +                    \
+     CFG_TUD_VENDOR * TUD_VENDOR_DESC_LEN)
 
 #if CFG_TUSB_MCU == OPT_MCU_LPC175X_6X ||                                      \
     CFG_TUSB_MCU == OPT_MCU_LPC177X_8X || CFG_TUSB_MCU == OPT_MCU_LPC40XX
@@ -101,6 +106,9 @@ enum
 #    define EPNUM_CDC_1_OUT 0x05
 #    define EPNUM_CDC_1_IN 0x85
 
+#    define EPNUM_VENDOR_OUT 0x08
+#    define EPNUM_VENDOR_IN 0x88
+
 #elif CFG_TUSB_MCU == OPT_MCU_SAMG || CFG_TUSB_MCU == OPT_MCU_SAMX7X
 // SAMG & SAME70 don't support a same endpoint number with different direction
 // IN and OUT
@@ -113,6 +121,9 @@ enum
 #    define EPNUM_CDC_1_OUT 0x05
 #    define EPNUM_CDC_1_IN 0x86
 
+#    define EPNUM_VENDOR_OUT 0x07
+#    define EPNUM_VENDOR_IN 0x88
+
 #elif CFG_TUSB_MCU == OPT_MCU_FT90X || CFG_TUSB_MCU == OPT_MCU_FT93X
 // FT9XX doesn't support a same endpoint number with different direction IN and
 // OUT
@@ -125,6 +136,9 @@ enum
 #    define EPNUM_CDC_1_OUT 0x05
 #    define EPNUM_CDC_1_IN 0x86
 
+#    define EPNUM_VENDOR_OUT 0x07
+#    define EPNUM_VENDOR_IN 0x88
+
 #else
 #    define EPNUM_CDC_0_NOTIF 0x81
 #    define EPNUM_CDC_0_OUT 0x02
@@ -133,6 +147,9 @@ enum
 #    define EPNUM_CDC_1_NOTIF 0x83
 #    define EPNUM_CDC_1_OUT 0x04
 #    define EPNUM_CDC_1_IN 0x84
+
+#    define EPNUM_VENDOR_OUT 0x05
+#    define EPNUM_VENDOR_IN 0x85
 #endif
 
 uint8_t const desc_fs_configuration[] = {
@@ -149,6 +166,13 @@ uint8_t const desc_fs_configuration[] = {
     // size, EP data address (out, in) and size.
     TUD_CDC_DESCRIPTOR(ITF_NUM_CDC_1, 4, EPNUM_CDC_1_NOTIF, 8, EPNUM_CDC_1_OUT,
                        EPNUM_CDC_1_IN, 64),
+
+#if CFG_TUD_VENDOR
+    // Vendor: Interface number, string index, EP data address (out, in) and
+    // size. Plain bulk pair for the command channel, no BOS/WinUSB descriptors.
+    TUD_VENDOR_DESCRIPTOR(ITF_NUM_VENDOR, 5, EPNUM_VENDOR_OUT, EPNUM_VENDOR_IN,
+                          64),
+#endif
 };
 
 #if TUD_OPT_HIGH_SPEED
@@ -169,6 +193,13 @@ uint8_t const desc_hs_configuration[] = {
     // size, EP data address (out, in) and size.
     TUD_CDC_DESCRIPTOR(ITF_NUM_CDC_1, 4, EPNUM_CDC_1_NOTIF, 8, EPNUM_CDC_1_OUT,
                        EPNUM_CDC_1_IN, 512),
+
+#if CFG_TUD_VENDOR
+    // Vendor: Interface number, string index, EP data address (out, in) and
+    // size. Plain bulk pair for the command channel, no BOS/WinUSB descriptors.
+    TUD_VENDOR_DESCRIPTOR(ITF_NUM_VENDOR, 5, EPNUM_VENDOR_OUT, EPNUM_VENDOR_IN,
+                          512),
+#endif
 };
 
 // device qualifier is mostly similar to device descriptor since we don't change
@@ -239,6 +270,7 @@ char const* string_desc_arr[] = {
     "CANBusProject",            // 2: Product
     usb_serial_id,              // 3: Serials, should use chip ID
     "CANBusProjectUART",        // 4: CDC Interface
+    "CANBusProjectCommand",     // 5: Vendor Interface
 };
 
 static uint16_t _desc_str[32];
@@ -1,18 +1,16 @@
 #include "button.h"
 
 Button::Button()
-    : m_LastTransition(time_us_64()), m_State(ButtonState::Idle),
-      m_New(false){};
+    : m_LastTransition(0), m_State(ButtonState::Idle), m_New(false){};
 
-void Button::update(bool pressed)
+void Button::update(bool pressed, uint64_t now)
 {
     m_New = false;
 
     if (!pressed && m_State == ButtonState::Idle)
         return;
 
-    uint64_t now = time_us_64();
-    int diff = now - m_LastTransition;
+    int diff = (int)(now - m_LastTransition);
 
     ButtonState next = ButtonState::Idle;
     switch (m_State)
@@ -74,6 +72,27 @@ bool Button::is_released()
            (m_State == ButtonState::ClickUp || m_State == ButtonState::OtherUp);
 }
 
+uint64_t Button::next_deadline() const
+{
+    switch (m_State)
+    {
+        case ButtonState::Debounce:
+        case ButtonState::DoubleClickDebounce:
+            return m_LastTransition + DEBOUNCE_DELAY;
+        case ButtonState::Pressed: return m_LastTransition + LONGCLICK_DELAY;
+        case ButtonState::ClickIdle:
+            return m_LastTransition + SINGLECLICK_DELAY;
+
+        // NOTE(patrik): Passed through on the next update
+        case ButtonState::ClickUp:
+        case ButtonState::SingleClick:
+        case ButtonState::OtherUp: return 0;
+
+        // NOTE(patrik): Waiting for an edge
+        default: return NO_DEADLINE;
+    }
+}
+
 ButtonState Button::check_idle(bool pressed, int diff)
 {
     return pressed ? ButtonState::Debounce : ButtonState::Idle;
@@ -2,6 +2,8 @@
 
 #include "pico/stdlib.h"
 
+#include "common.h"
+
 // NOTE(patrik): https://github.com/poelstra/arduino-multi-button
 
 const int DEBOUNCE_DELAY = 50 * 1000;     // us
@@ -31,7 +33,7 @@ class Button
 public:
     Button();
 
-    void update(bool pressed);
+    void update(bool pressed, uint64_t now);
 
     bool is_click() const;
     bool is_released();
@@ -40,6 +42,10 @@ public:
     bool is_double_click();
     bool is_long_click();
 
+    // NOTE(patrik): When update needs to run again to advance the state
+    // machine without a new edge on the line
+    uint64_t next_deadline() const;
+
     ButtonState check_idle(bool pressed, int diff);
 
     ButtonState check_debounce(bool pressed, int diff);
@@ -0,0 +1,212 @@
+#include "button_bank.h"
+
+// NOTE(patrik): Same state machine as Button, minus the states that only
+// existed to hold a flag for one update, those are events now
+enum ButtonBankState : uint8_t
+{
+    STATE_IDLE,
+    STATE_DEBOUNCE,
+    STATE_PRESSED,
+    STATE_CLICK_IDLE,
+    STATE_DOUBLE_CLICK_DEBOUNCE,
+    STATE_DOUBLE_CLICK,
+    STATE_LONG_CLICK,
+
+    NUM_STATES,
+};
+
+enum ButtonInput : uint8_t
+{
+    INPUT_DOWN,
+    INPUT_UP,
+    INPUT_TIMEOUT,
+
+    NUM_INPUTS,
+};
+
+enum ButtonTimer : uint8_t
+{
+    TIMER_NONE,
+    TIMER_DEBOUNCE,
+    TIMER_SINGLE_CLICK,
+    TIMER_LONG_CLICK,
+};
+
+const uint8_t NO_EVENT = 0xff;
+
+struct Transition
+{
+    uint8_t next;
+    uint8_t event;
+};
+
+#define GOTO(state) {state, NO_EVENT}
+#define EMIT(state, event) {state, (uint8_t)ButtonEventType::event}
+
+static const Transition transitions[NUM_STATES][NUM_INPUTS] = {
+    // STATE_IDLE
+    {GOTO(STATE_DEBOUNCE), GOTO(STATE_IDLE), GOTO(STATE_IDLE)},
+    // STATE_DEBOUNCE
+    {GOTO(STATE_DEBOUNCE), GOTO(STATE_IDLE), EMIT(STATE_PRESSED, Press)},
+    // STATE_PRESSED
+    {GOTO(STATE_PRESSED), EMIT(STATE_CLICK_IDLE, Release),
+     EMIT(STATE_LONG_CLICK, LongClick)},
+    // STATE_CLICK_IDLE
+    {GOTO(STATE_DOUBLE_CLICK_DEBOUNCE), GOTO(STATE_CLICK_IDLE),
+     EMIT(STATE_IDLE, SingleClick)},
+    // STATE_DOUBLE_CLICK_DEBOUNCE
+    {GOTO(STATE_DOUBLE_CLICK_DEBOUNCE), GOTO(STATE_CLICK_IDLE),
+     EMIT(STATE_DOUBLE_CLICK, DoubleClick)},
+    // STATE_DOUBLE_CLICK
+    {GOTO(STATE_DOUBLE_CLICK), EMIT(STATE_IDLE, Release),
+     GOTO(STATE_DOUBLE_CLICK)},
+    // STATE_LONG_CLICK
+    {GOTO(STATE_LONG_CLICK), EMIT(STATE_IDLE, Release),
+     GOTO(STATE_LONG_CLICK)},
+};
+
+#undef GOTO
+#undef EMIT
+
+static const uint8_t state_timers[NUM_STATES] = {
+    TIMER_NONE,         // STATE_IDLE
+    TIMER_DEBOUNCE,     // STATE_DEBOUNCE
+    TIMER_LONG_CLICK,   // STATE_PRESSED
+    TIMER_SINGLE_CLICK, // STATE_CLICK_IDLE
+    TIMER_DEBOUNCE,     // STATE_DOUBLE_CLICK_DEBOUNCE
+    TIMER_NONE,         // STATE_DOUBLE_CLICK
+    TIMER_NONE,         // STATE_LONG_CLICK
+};
+
+static uint64_t timeout(const ButtonTiming& timing, uint8_t state)
+{
+    switch (state_timers[state])
+    {
+        case TIMER_DEBOUNCE: return timing.debounce;
+        case TIMER_SINGLE_CLICK: return timing.single_click;
+        case TIMER_LONG_CLICK: return timing.long_click;
+        default: return NO_DEADLINE;
+    }
+}
+
+void ButtonBank::init(size_t num_buttons)
+{
+    m_num_buttons = num_buttons < MAX_BUTTONS ? num_buttons : MAX_BUTTONS;
+
+    for (size_t i = 0; i < m_num_buttons; i++)
+    {
+        m_state[i] = STATE_IDLE;
+        m_since[i] = 0;
+        m_timing[i] = DEFAULT_BUTTON_TIMING;
+    }
+
+    m_active = 0;
+}
+
+void ButtonBank::set_timing(size_t button, const ButtonTiming& timing)
+{
+    m_timing[button] = timing;
+}
+
+void ButtonBank::step(size_t button, uint8_t input, uint64_t time)
+{
+    const Transition& transition = transitions[m_state[button]][input];
+    if (transition.next == m_state[button])
+        return;
+
+    m_state[button] = transition.next;
+    m_since[button] = time;
+
+    if (transition.next == STATE_IDLE)
+        m_active &= ~(1u << button);
+    else
+        m_active |= 1u << button;
+
+    if (transition.event != NO_EVENT)
+    {
+        ButtonEvent event;
+        event.time = time;
+        event.button = (uint8_t)button;
+        event.type = (ButtonEventType)transition.event;
+
+        // NOTE(patrik): Dropped when nobody reads the queue
+        m_events.push(event);
+    }
+}
+
+void ButtonBank::expire(size_t button, uint64_t now)
+{
+    // NOTE(patrik): A late update can be past more than one timeout, e.g.
+    // both the debounce and the long click, each one happens at the time
+    // it ran out
+    while (true)
+    {
+        uint64_t delay = timeout(m_timing[button], m_state[button]);
+        if (delay == NO_DEADLINE || now - m_since[button] < delay)
+            return;
+
+        step(button, INPUT_TIMEOUT, m_since[button] + delay);
+    }
+}
+
+void ButtonBank::update(uint64_t now)
+{
+    uint32_t active = m_active;
+    while (active)
+    {
+        size_t button = __builtin_ctz(active);
+        active &= active - 1;
+
+        expire(button, now);
+    }
+}
+
+void ButtonBank::update(uint32_t down, uint64_t now)
+{
+    // NOTE(patrik): Nothing pressed and nothing waiting on a timeout
+    if (down == 0 && m_active == 0)
+        return;
+
+    update(now);
+
+    uint32_t changed = down | m_active;
+    while (changed)
+    {
+        size_t button = __builtin_ctz(changed);
+        changed &= changed - 1;
+
+        if (button >= m_num_buttons)
+            break;
+
+        step(button, (down >> button) & 1 ? INPUT_DOWN : INPUT_UP, now);
+    }
+}
+
+void ButtonBank::edge(size_t button, bool down, uint64_t time)
+{
+    if (button >= m_num_buttons)
+        return;
+
+    // NOTE(patrik): Timeouts that ran out before the edge happen first
+    expire(button, time);
+
+    step(button, down ? INPUT_DOWN : INPUT_UP, time);
+}
+
+uint64_t ButtonBank::next_deadline() const
+{
+    uint64_t deadline = NO_DEADLINE;
+
+    uint32_t active = m_active;
+    while (active)
+    {
+        size_t button = __builtin_ctz(active);
+        active &= active - 1;
+
+        uint64_t delay = timeout(m_timing[button], m_state[button]);
+        if (delay != NO_DEADLINE && m_since[button] + delay < deadline)
+            deadline = m_since[button] + delay;
+    }
+
+    return deadline;
+}
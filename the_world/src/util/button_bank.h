@@ -0,0 +1,83 @@
+#pragma once
+
+#include "common.h"
+#include "util/spsc_queue.h"
+
+// NOTE(patrik): Click detection for many buttons at once. Every button runs
+// the same transition table (see button_bank.cpp) over a struct of arrays
+// state, with its own timings. Instead of flags that only hold for one
+// update, everything a button does goes into an event queue so nothing gets
+// lost between reads.
+//
+// Buttons are fed the pressed level (update) or single edges (edge), both
+// with the time it was seen. Buttons sitting idle cost nothing.
+const size_t MAX_BUTTONS = 16;
+const size_t BUTTON_EVENT_QUEUE_SIZE = 32;
+
+struct ButtonTiming
+{
+    uint32_t debounce;     // us
+    uint32_t single_click; // us, how long to wait for a second click
+    uint32_t long_click;   // us
+};
+
+// NOTE(patrik): Same as the Button constants
+const ButtonTiming DEFAULT_BUTTON_TIMING = {
+    50 * 1000,
+    250 * 1000,
+    350 * 1000,
+};
+
+enum class ButtonEventType : uint8_t
+{
+    // NOTE(patrik): Pressed after debouncing, the second press of a double
+    // click only sends DoubleClick
+    Press,
+    Release,
+    SingleClick,
+    DoubleClick,
+    LongClick,
+};
+
+struct ButtonEvent
+{
+    uint64_t time;
+    uint8_t button;
+    ButtonEventType type;
+};
+
+class ButtonBank
+{
+public:
+    void init(size_t num_buttons);
+    void set_timing(size_t button, const ButtonTiming& timing);
+
+    // NOTE(patrik): down has a bit per button, runs the timeouts up to now
+    void update(uint32_t down, uint64_t now);
+    // NOTE(patrik): A single edge at time, call update(now) afterwards to
+    // run the timeouts
+    void edge(size_t button, bool down, uint64_t time);
+    void update(uint64_t now);
+
+    bool pop_event(ButtonEvent* event) { return m_events.pop(event); }
+
+    // NOTE(patrik): When update needs to run again for a timeout
+    uint64_t next_deadline() const;
+
+private:
+    void step(size_t button, uint8_t input, uint64_t time);
+    void expire(size_t button, uint64_t now);
+
+private:
+    size_t m_num_buttons = 0;
+
+    // NOTE(patrik): Struct of arrays, one entry per button
+    uint8_t m_state[MAX_BUTTONS] = {};
+    uint64_t m_since[MAX_BUTTONS] = {};
+    ButtonTiming m_timing[MAX_BUTTONS] = {};
+
+    // NOTE(patrik): Buttons that aren't idle, the only ones with timeouts
+    uint32_t m_active = 0;
+
+    SpscQueue<ButtonEvent, BUTTON_EVENT_QUEUE_SIZE> m_events;
+};
@@ -0,0 +1,133 @@
+#include "chord.h"
+
+void ChordRecognizer::init(const Chord* chords, size_t num_chords,
+                           uint32_t settle, uint32_t release)
+{
+    m_chords = chords;
+    m_num_chords = num_chords < MAX_CHORDS ? num_chords : MAX_CHORDS;
+    m_settle = settle;
+    m_release = release;
+
+    m_mask = 0;
+    for (size_t i = 0; i < m_num_chords; i++)
+        m_mask |= m_chords[i].lines;
+
+    m_state = State::Idle;
+    m_held = 0;
+    m_chord = NO_CHORD;
+}
+
+uint8_t ChordRecognizer::match(uint32_t lines) const
+{
+    uint8_t best = NO_CHORD;
+    int best_lines = 0;
+
+    // NOTE(patrik): Any chord that is fully held can match, so an extra
+    // line brushed by accident doesn't throw the whole chord away
+    for (size_t i = 0; i < m_num_chords; i++)
+    {
+        const Chord& chord = m_chords[i];
+        if ((chord.lines & lines) != chord.lines)
+            continue;
+
+        int num_lines = __builtin_popcount(chord.lines);
+        if (best != NO_CHORD)
+        {
+            uint8_t priority = m_chords[best].priority;
+            if (chord.priority < priority)
+                continue;
+            if (chord.priority == priority && num_lines <= best_lines)
+                continue;
+        }
+
+        best = (uint8_t)i;
+        best_lines = num_lines;
+    }
+
+    return best;
+}
+
+void ChordRecognizer::emit(uint8_t chord, ChordEventType type, uint64_t time)
+{
+    ChordEvent event;
+    event.time = time;
+    event.chord = chord;
+    event.type = type;
+
+    // NOTE(patrik): Dropped when nobody reads the queue
+    m_events.push(event);
+}
+
+void ChordRecognizer::update(uint32_t lines, uint64_t now)
+{
+    lines &= m_mask;
+
+    switch (m_state)
+    {
+        case State::Idle:
+            if (lines)
+            {
+                m_state = State::Settle;
+                m_held = lines;
+                m_since = now;
+            }
+            break;
+
+        case State::Settle:
+            // NOTE(patrik): The chord is whatever is still held when the
+            // window runs out. A line let go of during the window (rolling
+            // from one button to the next) was never held together with the
+            // others, and everything released is a glitch.
+            if (!lines)
+            {
+                m_state = State::Idle;
+                break;
+            }
+
+            m_held = lines;
+            if (now - m_since < m_settle)
+                break;
+
+            m_chord = match(m_held);
+            if (m_chord != NO_CHORD)
+                emit(m_chord, ChordEventType::Press, m_since + m_settle);
+            m_state = State::Held;
+            break;
+
+        case State::Held:
+            // NOTE(patrik): Lines coming and going while held don't change
+            // the chord, only letting go of all of them does
+            if (!lines)
+            {
+                m_state = State::Release;
+                m_since = now;
+            }
+            break;
+
+        case State::Release:
+            if (lines)
+            {
+                m_state = State::Held;
+                break;
+            }
+
+            if (now - m_since < m_release)
+                break;
+
+            if (m_chord != NO_CHORD)
+                emit(m_chord, ChordEventType::Release, m_since);
+            m_chord = NO_CHORD;
+            m_state = State::Idle;
+            break;
+    }
+}
+
+uint64_t ChordRecognizer::next_deadline() const
+{
+    switch (m_state)
+    {
+        case State::Settle: return m_since + m_settle;
+        case State::Release: return m_since + m_release;
+        default: return NO_DEADLINE;
+    }
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "common.h"
+#include "util/spsc_queue.h"
+
+// NOTE(patrik): Recognizes combinations of lines pressed together (chords).
+// Lines pressed within the settle window of the first one count as one
+// chord, when the window runs out the lines still held are matched against
+// the chord table once and the chord stays until every line is released. So
+// pressing two buttons a bit apart gives one event for the pair and none
+// for the button that went down first, and rolling from one button to
+// another within the window only gives the second one.
+//
+// Each sample is a handful of mask operations no matter how many lines are
+// in the mask, the table is only searched once per chord.
+const size_t MAX_CHORDS = 16;
+const size_t CHORD_EVENT_QUEUE_SIZE = 16;
+
+const uint8_t NO_CHORD = 0xff;
+
+struct Chord
+{
+    uint32_t lines;
+    // NOTE(patrik): When more than one chord is held, the highest priority
+    // wins, and with the same priority the one with the most lines
+    uint8_t priority;
+};
+
+enum class ChordEventType : uint8_t
+{
+    Press,
+    Release,
+};
+
+struct ChordEvent
+{
+    uint64_t time;
+    uint8_t chord;
+    ChordEventType type;
+};
+
+class ChordRecognizer
+{
+public:
+    // NOTE(patrik): settle and release are in us, release is how long
+    // every line needs to stay up before the chord is released
+    void init(const Chord* chords, size_t num_chords, uint32_t settle,
+              uint32_t release);
+
+    // NOTE(patrik): lines has a bit per line, set when the line is pressed
+    void update(uint32_t lines, uint64_t now);
+
+    bool pop_event(ChordEvent* event) { return m_events.pop(event); }
+
+    // NOTE(patrik): When update needs to run again for a timeout
+    uint64_t next_deadline() const;
+
+    // NOTE(patrik): The chord being held, or NO_CHORD
+    uint8_t current() const { return m_chord; }
+
+private:
+    enum class State : uint8_t
+    {
+        Idle,
+        Settle,
+        Held,
+        Release,
+    };
+
+    uint8_t match(uint32_t lines) const;
+    void emit(uint8_t chord, ChordEventType type, uint64_t time);
+
+private:
+    const Chord* m_chords = nullptr;
+    size_t m_num_chords = 0;
+
+    uint32_t m_settle = 0;
+    uint32_t m_release = 0;
+
+    // NOTE(patrik): Every line that shows up in a chord, the rest are
+    // ignored
+    uint32_t m_mask = 0;
+
+    State m_state = State::Idle;
+    uint32_t m_held = 0;
+    uint64_t m_since = 0;
+    uint8_t m_chord = NO_CHORD;
+
+    SpscQueue<ChordEvent, CHORD_EVENT_QUEUE_SIZE> m_events;
+};
@@ -0,0 +1,44 @@
+#include "control_bank.h"
+
+#include <hardware/gpio.h>
+
+void ControlBank::init_pin(uint32_t pin, bool on)
+{
+    uint32_t mask = 1u << pin;
+
+    if (on)
+        m_shadow |= mask;
+    else
+        m_shadow &= ~mask;
+    m_dirty &= ~mask;
+}
+
+void ControlBank::set(uint32_t pin, bool on)
+{
+    uint32_t mask = 1u << pin;
+
+    m_stats.num_sets++;
+    if (((m_shadow & mask) != 0) == on)
+    {
+        m_stats.writes_saved++;
+        return;
+    }
+
+    // NOTE(patrik): Setting a pin back before the commit makes it clean
+    // again
+    m_shadow ^= mask;
+    m_dirty ^= mask;
+}
+
+bool ControlBank::commit()
+{
+    if (m_dirty == 0)
+        return false;
+
+    gpio_put_masked(m_dirty, m_shadow);
+
+    m_stats.num_commits++;
+    m_stats.writes_saved += __builtin_popcount(m_dirty) - 1;
+    m_dirty = 0;
+    return true;
+}
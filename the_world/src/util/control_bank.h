@@ -0,0 +1,41 @@
+#pragma once
+
+#include "common.h"
+
+// NOTE(patrik): Shadow of the control outputs in GPIO bit order. Controls
+// only mark their pin dirty, commit writes every dirty pin with a single
+// gpio_put_masked so outputs that change together switch together, and an
+// output that didn't change is never written.
+//
+// Only from the update thread, the stats are read from COM without a lock.
+struct ControlBankStats
+{
+    uint32_t num_sets;
+    uint32_t num_commits;
+    // NOTE(patrik): GPIO writes the per control gpio_put would have done on
+    // top of the commits (sets that didn't change anything and pins that
+    // shared a commit)
+    uint32_t writes_saved;
+};
+
+class ControlBank
+{
+public:
+    // NOTE(patrik): For a pin that was just written directly, only updates
+    // the shadow
+    void init_pin(uint32_t pin, bool on);
+
+    void set(uint32_t pin, bool on);
+    // NOTE(patrik): Returns true when it changed any output
+    bool commit();
+
+    uint32_t outputs() const { return m_shadow; }
+    ControlBankStats stats() const { return m_stats; }
+
+private:
+    uint32_t m_shadow = 0;
+    // NOTE(patrik): Pins where the shadow differs from what was last written
+    uint32_t m_dirty = 0;
+
+    ControlBankStats m_stats = {};
+};
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <stdint.h>
+
+// NOTE(patrik): When the tick after the one at tick is, given the update for
+// it finished at now. Like vTaskDelayUntil the ticks stay on the grid set by
+// the first one. Ticks that are already due by now are skipped instead of
+// run back to back to catch up, and counted in missed.
+inline uint64_t fixed_rate_next(uint64_t tick, uint64_t now, uint32_t period,
+                                uint32_t* missed)
+{
+    uint64_t next = tick + period;
+    if (now < next)
+    {
+        *missed = 0;
+        return next;
+    }
+
+    uint64_t num_missed = (now - next) / period + 1;
+    *missed = (uint32_t)num_missed;
+    return next + num_missed * period;
+}
@@ -0,0 +1,39 @@
+#include "gpio_irq.h"
+
+#include "trace.h"
+
+#include <hardware/gpio.h>
+
+static GpioIrqHandler handlers[NUM_BANK0_GPIOS];
+static uint32_t handler_events[NUM_BANK0_GPIOS];
+static bool enabled = false;
+
+static void gpio_callback(uint gpio, uint32_t events)
+{
+    trace_event(TRACE_GPIO_IRQ, (uint16_t)(gpio | events << 8));
+
+    if (gpio < NUM_BANK0_GPIOS && handlers[gpio])
+        handlers[gpio](gpio, events);
+}
+
+void gpio_irq_set_handler(uint32_t pin, uint32_t events,
+                          GpioIrqHandler handler)
+{
+    handlers[pin] = handler;
+    handler_events[pin] = events;
+
+    if (enabled)
+        gpio_set_irq_enabled_with_callback(pin, events, true, gpio_callback);
+}
+
+void gpio_irq_enable()
+{
+    enabled = true;
+
+    for (uint32_t pin = 0; pin < NUM_BANK0_GPIOS; pin++)
+    {
+        if (handlers[pin])
+            gpio_set_irq_enabled_with_callback(pin, handler_events[pin], true,
+                                               gpio_callback);
+    }
+}
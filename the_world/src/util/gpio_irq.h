@@ -0,0 +1,15 @@
+#pragma once
+
+#include "common.h"
+
+typedef void (*GpioIrqHandler)(uint32_t pin, uint32_t events);
+
+// NOTE(patrik): The SDK only takes one GPIO callback, this fans it out to a
+// handler per pin. Handlers run in interrupt context.
+void gpio_irq_set_handler(uint32_t pin, uint32_t events,
+                          GpioIrqHandler handler);
+
+// NOTE(patrik): GPIO interrupts are taken on the core that enables them, so
+// handlers are only recorded until the update thread calls this from its own
+// core. Handlers set after that are enabled right away.
+void gpio_irq_enable();
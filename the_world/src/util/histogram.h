@@ -0,0 +1,65 @@
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+// NOTE(patrik): Log-linear (HDR style) latency histogram with a fixed
+// amount of memory. Values below 16 get a bucket each, above that every
+// power of two is split into 8 linear sub-buckets, so the error stays
+// under 12.5% all the way up. Values from 2^24 (~16 s) up all land in the
+// last bucket.
+//
+// There is one writer (record) and one reader (take). The writer never
+// does more than a load and a store per bucket, the Cortex-M0+ has no
+// atomic read-modify-write instructions and we don't want a lock in the
+// hot path. The reader never writes the counts, a reset just moves its
+// baseline up to the current counts.
+class Histogram
+{
+public:
+    static const uint32_t SUB_BUCKET_BITS = 3;
+    static const uint32_t SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+    static const uint32_t MAX_BIT = 23;
+    static const size_t NUM_BUCKETS =
+        (MAX_BIT - SUB_BUCKET_BITS + 2) * SUB_BUCKETS;
+
+    static size_t bucket_index(uint32_t value)
+    {
+        if (value < SUB_BUCKETS)
+            return value;
+
+        uint32_t msb = 31 - __builtin_clz(value);
+        if (msb > MAX_BIT)
+            return NUM_BUCKETS - 1;
+
+        uint32_t shift = msb - SUB_BUCKET_BITS;
+        return (msb - SUB_BUCKET_BITS + 1) * SUB_BUCKETS +
+               ((value >> shift) & (SUB_BUCKETS - 1));
+    }
+
+    void record(uint32_t value)
+    {
+        std::atomic<uint32_t>& count = m_counts[bucket_index(value)];
+        count.store(count.load(std::memory_order_relaxed) + 1,
+                    std::memory_order_relaxed);
+    }
+
+    // NOTE(patrik): Copies the counts since the last reset into out
+    // (NUM_BUCKETS entries), reset starts a new interval
+    void take(uint32_t* out, bool reset)
+    {
+        for (size_t i = 0; i < NUM_BUCKETS; i++)
+        {
+            uint32_t count = m_counts[i].load(std::memory_order_relaxed);
+            out[i] = count - m_baseline[i];
+
+            if (reset)
+                m_baseline[i] = count;
+        }
+    }
+
+private:
+    std::atomic<uint32_t> m_counts[NUM_BUCKETS] = {};
+    uint32_t m_baseline[NUM_BUCKETS] = {};
+};
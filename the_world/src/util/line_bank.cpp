@@ -0,0 +1,37 @@
+#include "line_bank.h"
+
+#include <hardware/gpio.h>
+
+void LineBank::init(const uint32_t* pins, size_t num_pins)
+{
+    if (num_pins > LINE_BANK_SIZE)
+        num_pins = LINE_BANK_SIZE;
+
+    m_mask = 0;
+    for (size_t i = 0; i < num_pins; i++)
+    {
+        m_line_masks[i] = 1u << pins[i];
+        m_mask |= m_line_masks[i];
+    }
+
+    // NOTE(patrik): Start from whatever the lines read now instead of
+    // reporting every held line as a press
+    m_state = ~gpio_get_all() & m_mask;
+    m_changed = 0;
+    m_count0 = 0;
+    m_count1 = 0;
+}
+
+void LineBank::sample()
+{
+    uint32_t raw = ~gpio_get_all() & m_mask;
+
+    // NOTE(patrik): Bits that differ from the debounced state count up, the
+    // rest are reset. When a counter wraps the state flips.
+    uint32_t delta = raw ^ m_state;
+    m_count1 = (m_count1 ^ m_count0) & delta;
+    m_count0 = ~m_count0 & delta;
+
+    m_changed = delta & ~(m_count0 | m_count1);
+    m_state ^= m_changed;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "common.h"
+
+// NOTE(patrik): Samples every input line with one gpio_get_all() and
+// debounces all of them at once with a two bit vertical counter per GPIO,
+// a line has to read the same for DEBOUNCE_SAMPLES samples in a row before
+// its state flips. Everything is kept in GPIO bit order so a sample costs
+// the same no matter how many lines are in use.
+//
+// Lines are active low like PhysicalLine, a set bit means pulled to ground.
+//
+// The debounce is counted in samples, so it only means something on a fixed
+// schedule. A device with an update_period owns one and samples it at the
+// top of its update, event driven devices use the InputEvents instead.
+const size_t LINE_BANK_SIZE = 16;
+
+class LineBank
+{
+public:
+    static const uint32_t DEBOUNCE_SAMPLES = 4;
+
+    // NOTE(patrik): Pins past LINE_BANK_SIZE are left out
+    void init(const uint32_t* pins, size_t num_pins);
+
+    // NOTE(patrik): Once per tick, the debounce time is DEBOUNCE_SAMPLES
+    // times spec.update_period
+    void sample();
+
+    // NOTE(patrik): Masks in GPIO bit order
+    uint32_t state() const { return m_state; }
+    // NOTE(patrik): Lines that went down / came back up on the last sample
+    uint32_t pressed() const { return m_changed & m_state; }
+    uint32_t released() const { return m_changed & ~m_state; }
+
+    // NOTE(patrik): Per line, index into spec.lines
+    bool is_down(size_t line) const { return m_state & m_line_masks[line]; }
+    bool is_pressed(size_t line) const
+    {
+        return pressed() & m_line_masks[line];
+    }
+    bool is_released(size_t line) const
+    {
+        return released() & m_line_masks[line];
+    }
+
+    uint32_t line_mask(size_t line) const { return m_line_masks[line]; }
+
+private:
+    uint32_t m_line_masks[LINE_BANK_SIZE] = {};
+    uint32_t m_mask = 0;
+
+    uint32_t m_state = 0;
+    uint32_t m_changed = 0;
+    uint32_t m_count0 = 0;
+    uint32_t m_count1 = 0;
+};
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+
+// NOTE(patrik): Double buffered seqlock, one writer and any number of
+// readers and neither side ever waits on the other. The writer fills the
+// buffer the readers aren't pointed at and then bumps the sequence number
+// to publish it (odd while a write is in progress). A reader copies the
+// published buffer and only has to retry when the writer got around to
+// writing that same buffer again during the copy, which takes two writes.
+//
+// T needs to be trivially copyable.
+template <typename T>
+class Seqlock
+{
+public:
+    void write(const T& value)
+    {
+        uint32_t seq = m_seq.load(std::memory_order_relaxed);
+
+        m_seq.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        m_buffers[((seq >> 1) + 1) & 1] = value;
+
+        m_seq.store(seq + 2, std::memory_order_release);
+    }
+
+    // NOTE(patrik): Returns the number of writes published before the copy,
+    // a reader can compare it with the last one to see if anything changed
+    uint32_t read(T* value) const
+    {
+        while (true)
+        {
+            uint32_t seq = m_seq.load(std::memory_order_acquire);
+            *value = m_buffers[(seq >> 1) & 1];
+            std::atomic_thread_fence(std::memory_order_acquire);
+
+            // NOTE(patrik): The buffer just copied only gets touched again
+            // when the write after the next one starts (seq + 3)
+            uint32_t now = m_seq.load(std::memory_order_relaxed);
+            if (now - (seq & ~1u) < 3)
+                return seq >> 1;
+        }
+    }
+
+    uint32_t version() const
+    {
+        return m_seq.load(std::memory_order_acquire) >> 1;
+    }
+
+private:
+    T m_buffers[2] = {};
+    std::atomic<uint32_t> m_seq{0};
+};
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+
+// NOTE(patrik): Lock-free single producer / single consumer ring buffer.
+// Only the producer writes m_head and only the consumer writes m_tail, so
+// the two sides can live on different tasks (or cores) without a lock.
+// N needs to be a power of two.
+template <typename T, size_t N>
+class SpscQueue
+{
+    static_assert(N > 0 && (N & (N - 1)) == 0, "N must be a power of two");
+
+public:
+    bool push(const T& value)
+    {
+        size_t head = m_head.load(std::memory_order_relaxed);
+        size_t tail = m_tail.load(std::memory_order_acquire);
+
+        if (head - tail >= N)
+            return false;
+
+        m_items[head & (N - 1)] = value;
+        m_head.store(head + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    bool pop(T* value)
+    {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        size_t head = m_head.load(std::memory_order_acquire);
+
+        if (head == tail)
+            return false;
+
+        *value = m_items[tail & (N - 1)];
+        m_tail.store(tail + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    bool empty() const { return size() == 0; }
+
+    size_t size() const
+    {
+        return m_head.load(std::memory_order_acquire) -
+               m_tail.load(std::memory_order_acquire);
+    }
+
+private:
+    T m_items[N];
+
+    std::atomic<size_t> m_head{0};
+    std::atomic<size_t> m_tail{0};
+};
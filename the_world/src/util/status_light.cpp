@@ -1,118 +1,137 @@
 #include "status_light.h"
 #include "device.h"
 
-#include <pico/stdlib.h>
-#include <hardware/gpio.h>
+static StatusLight* lights[MAX_STATUS_LIGHTS];
+static size_t num_lights = 0;
 
-void StatusLight::init(PhysicalControl* control) { m_control = control; }
+// NOTE(patrik): Earliest transition of all the lights, 0 when a light has a
+// new pattern to pick up
+static uint64_t next_transition = NO_DEADLINE;
 
-void StatusLight::update()
+static uint8_t slot_index(const LightPattern* pattern)
 {
-    uint32_t current_time = time_us_64();
-
-    if (m_state_changed)
-    {
-        switch (m_state)
-        {
-            case StatusLightState::On: m_control->set(true); break;
-            case StatusLightState::Off: m_control->set(false); break;
-
-            case StatusLightState::Blink:
-            case StatusLightState::BlinkCount: {
-                m_last_time = current_time;
-                m_control->set(true);
-                m_blink_value = true;
-            }
-            break;
-        }
-
-        m_state_changed = false;
-    }
+    return pattern->priority < MAX_LIGHT_PRIORITY ? pattern->priority
+                                                  : MAX_LIGHT_PRIORITY - 1;
+}
 
-    switch (m_state)
-    {
-        case StatusLightState::Blink: {
-            if (current_time - m_last_time > m_blink_time)
-            {
-                m_blink_value = !m_blink_value;
-                m_control->set(m_blink_value);
-                m_last_time = current_time;
-            }
-        }
+void StatusLight::init(PhysicalControl* control)
+{
+    m_control = control;
 
-        case StatusLightState::BlinkCount: {
-            if (current_time - m_last_time > m_blink_time)
-            {
-                if (m_current_blink_count >= m_blink_count)
-                {
-                    m_control->set(false);
-                }
-                else
-                {
-                    m_blink_value = !m_blink_value;
-                    m_control->set(m_blink_value);
-
-                    if (!m_blink_value)
-                        m_current_blink_count++;
-                }
-
-                m_last_time = current_time;
-            }
-        }
+    if (num_lights < MAX_STATUS_LIGHTS)
+        lights[num_lights++] = this;
+}
 
-        break;
+void StatusLight::play(const LightPattern& pattern)
+{
+    uint8_t priority = slot_index(&pattern);
+    if (m_slots[priority] == &pattern)
+        return;
 
-        default: break;
-    }
+    m_slots[priority] = &pattern;
+    m_changed = true;
+    next_transition = 0;
 }
 
-void StatusLight::blink(uint64_t blink_time)
+void StatusLight::stop(uint8_t priority)
 {
-    if (m_state == StatusLightState::Blink)
+    if (priority >= MAX_LIGHT_PRIORITY || !m_slots[priority])
         return;
 
-    set_state(StatusLightState::Blink);
-    m_blink_time = blink_time;
+    m_slots[priority] = nullptr;
+    m_changed = true;
+    next_transition = 0;
 }
 
-void StatusLight::blink_toggle(uint64_t blink_time)
+void StatusLight::set(bool on) { play(on ? LIGHT_ON : LIGHT_OFF); }
+
+void StatusLight::start_step(uint64_t time)
 {
-    if (m_state == StatusLightState::Blink)
-        set(false);
+    const LightStep& step = m_active->steps[m_step];
+
+    m_step_start = time;
+    m_control->set(step.on);
+
+    if (step.duration_ms == 0)
+        m_next = NO_DEADLINE;
     else
-        blink(blink_time);
+        m_next = time + (uint64_t)step.duration_ms * 1000;
 }
 
-void StatusLight::blink_count(uint64_t blink_time, uint32_t blink_count)
+void StatusLight::select(uint64_t time)
 {
-    if (m_state == StatusLightState::BlinkCount)
+    const LightPattern* pattern = nullptr;
+    for (int i = MAX_LIGHT_PRIORITY - 1; i >= 0; i--)
+    {
+        if (m_slots[i])
+        {
+            pattern = m_slots[i];
+            break;
+        }
+    }
+
+    // NOTE(patrik): Only a pattern below the playing one changed, keep
+    // playing where it was
+    if (pattern == m_active)
         return;
 
-    set_state(StatusLightState::BlinkCount);
-    m_blink_time = blink_time;
-    m_blink_count = blink_count;
-    m_current_blink_count = 0;
-}
+    m_active = pattern;
+    m_step = 0;
+    m_repeat = 0;
 
-void StatusLight::set(bool on)
-{
-    if (on)
-        set_state(StatusLightState::On);
+    if (m_active)
+    {
+        start_step(time);
+    }
     else
-        set_state(StatusLightState::Off);
+    {
+        m_control->set(false);
+        m_next = NO_DEADLINE;
+    }
 }
 
-void StatusLight::toggle()
+void StatusLight::advance(uint64_t now)
 {
-    switch (m_state)
+    if (m_changed)
     {
-        case StatusLightState::On: set(false);
-        default: set(true);
+        m_changed = false;
+        select(now);
+    }
+
+    while (m_active && m_next <= now)
+    {
+        uint64_t time = m_next;
+
+        m_step++;
+        if (m_step >= m_active->num_steps)
+        {
+            m_step = 0;
+            m_repeat++;
+
+            if (m_active->repeat != 0 && m_repeat >= m_active->repeat)
+            {
+                m_slots[slot_index(m_active)] = nullptr;
+                select(time);
+                continue;
+            }
+        }
+
+        start_step(time);
     }
 }
 
-void StatusLight::set_state(StatusLightState new_state)
+uint64_t status_lights_update(uint64_t now)
 {
-    m_state = new_state;
-    m_state_changed = true;
+    if (now < next_transition)
+        return next_transition;
+
+    next_transition = NO_DEADLINE;
+    for (size_t i = 0; i < num_lights; i++)
+    {
+        lights[i]->advance(now);
+        if (lights[i]->m_next < next_transition)
+            next_transition = lights[i]->m_next;
+    }
+
+    return next_transition;
 }
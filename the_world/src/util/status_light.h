@@ -3,38 +3,98 @@
 #include "common.h"
 #include "device.h"
 
-enum class StatusLightState
+// NOTE(patrik): Lights play patterns, a list of on/off steps from a constant
+// table. A light holds one pattern per priority and plays the highest one,
+// when a pattern with a repeat count is done the light falls back to the
+// next one below it.
+//
+// Nothing runs per light between transitions. The update thread calls
+// status_lights_update every pass, it only walks the lights when the
+// earliest transition of all of them is due and the thread sleeps until
+// that one. Steps are timed from when the last one was scheduled, not from
+// when the update got to it, so a late update doesn't stretch the pattern.
+const size_t MAX_STATUS_LIGHTS = 8;
+const uint8_t MAX_LIGHT_PRIORITY = 4;
+
+struct LightStep
+{
+    bool on;
+    uint32_t duration_ms; // 0 holds the step forever
+};
+
+struct LightPattern
 {
-    Off,
-    On,
-    Blink,
-    BlinkCount,
+    const LightStep* steps;
+    uint8_t num_steps;
+    uint8_t repeat; // Times the steps are played, 0 repeats forever
+    uint8_t priority;
+};
+
+// NOTE(patrik): Takes the number of steps from the array so the two can't
+// drift apart
+template <size_t NumSteps>
+constexpr LightPattern light_pattern(const LightStep (&steps)[NumSteps],
+                                     uint8_t repeat, uint8_t priority)
+{
+    static_assert(NumSteps > 0 && NumSteps <= 255, "Bad number of steps");
+    return LightPattern{steps, (uint8_t)NumSteps, repeat, priority};
+}
+
+// NOTE(patrik): Base state of a light, priority 0
+inline constexpr LightStep LIGHT_STEPS_OFF[] = {{false, 0}};
+inline constexpr LightStep LIGHT_STEPS_ON[] = {{true, 0}};
+inline constexpr LightPattern LIGHT_OFF = light_pattern(LIGHT_STEPS_OFF, 0, 0);
+inline constexpr LightPattern LIGHT_ON = light_pattern(LIGHT_STEPS_ON, 0, 0);
+
+inline constexpr LightStep LIGHT_STEPS_BLINK_FAST[] = {
+    {true, 250},
+    {false, 250},
+};
+inline constexpr LightPattern LIGHT_BLINK_FAST =
+    light_pattern(LIGHT_STEPS_BLINK_FAST, 0, 1);
+
+inline constexpr LightStep LIGHT_STEPS_DOUBLE_BLINK[] = {
+    {true, 500},
+    {false, 500},
 };
+inline constexpr LightPattern LIGHT_DOUBLE_BLINK =
+    light_pattern(LIGHT_STEPS_DOUBLE_BLINK, 2, 2);
 
 struct StatusLight
 {
     void init(PhysicalControl* control);
 
-    void update();
-
-    void blink(uint64_t blink_time);
-    void blink_toggle(uint64_t blink_time);
-    void blink_count(uint64_t blink_time, uint32_t blink_count);
+    // NOTE(patrik): Playing a pattern that is already playing doesn't
+    // restart it, so devices can play a pattern that repeats forever
+    // (repeat 0) every update. A pattern with a repeat count is gone once
+    // it's done and playing it again starts it over, play those once per
+    // event instead.
+    void play(const LightPattern& pattern);
+    void stop(uint8_t priority);
 
+    // NOTE(patrik): LIGHT_ON / LIGHT_OFF
     void set(bool on);
-    void toggle();
 
 private:
-    void set_state(StatusLightState new_state);
+    friend uint64_t status_lights_update(uint64_t now);
+
+    void advance(uint64_t now);
+    void start_step(uint64_t time);
+    void select(uint64_t time);
 
 private:
     PhysicalControl* m_control = nullptr;
-    StatusLightState m_state = StatusLightState::Off;
-    bool m_state_changed = false;
-
-    uint64_t m_last_time = 0;
-    uint64_t m_blink_time = 0;
-    uint32_t m_blink_count = 0;
-    uint32_t m_current_blink_count = 0;
-    bool m_blink_value = false;
+
+    const LightPattern* m_slots[MAX_LIGHT_PRIORITY] = {};
+    const LightPattern* m_active = nullptr;
+    bool m_changed = false;
+
+    uint8_t m_step = 0;
+    uint8_t m_repeat = 0;
+    uint64_t m_step_start = 0;
+    uint64_t m_next = NO_DEADLINE;
 };
+
+// NOTE(patrik): Runs the transitions that are due and returns when the next
+// one is, from the update thread
+uint64_t status_lights_update(uint64_t now);